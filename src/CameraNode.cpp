@@ -1,27 +1,59 @@
+#include "change_detection.hpp"
 #include "clamp.hpp"
+#include "control_values.hpp"
 #include "cv_to_pv.hpp"
 #include "format_mapping.hpp"
+#include "frame_copy.hpp"
+#include "frame_file.hpp"
+#include "frame_memory.hpp"
+#include "frame_recorder.hpp"
+#include "frame_ring.hpp"
+#include "image_crop.hpp"
+#include "image_pyramid.hpp"
+#include "image_statistics.hpp"
+#include "jpeg_encoder.hpp"
+#include "load_shedding.hpp"
+#include "ordered_workers.hpp"
 #include "parameter_conflict_check.hpp"
 #include "pretty_print.hpp"
 #include "pv_to_cv.hpp"
+#include "quality_control.hpp"
+#include "rate_limit.hpp"
+#include "raw_compression.hpp"
+#include "rectification.hpp"
+#include "sensor_mode.hpp"
+#include "thread_scheduling.hpp"
 #include "type_extent.hpp"
 #include "types.hpp"
+#include "worker_pool.hpp"
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <camera_info_manager/camera_info_manager.hpp>
+#include <camera_ros/msg/control_descriptors.hpp>
+#include <camera_ros/msg/controls.hpp>
+#include <camera_ros/msg/frame_metadata.hpp>
+#include <camera_ros/msg/image_statistics.hpp>
+#include <camera_ros/srv/set_regions.hpp>
 #include <cassert>
 #include <cctype>
 #include <cerrno>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
 #include <cstring>
 #include <cv_bridge/cv_bridge.h>
+#include <diagnostic_updater/diagnostic_status_wrapper.hpp>
+#include <diagnostic_updater/diagnostic_updater.hpp>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <libcamera/base/shared_fd.h>
 #include <libcamera/base/signal.h>
 #include <libcamera/base/span.h>
 #include <libcamera/camera.h>
 #include <libcamera/camera_manager.h>
+#include <libcamera/control_ids.h>
 #include <libcamera/controls.h>
 #include <libcamera/framebuffer.h>
 #include <libcamera/framebuffer_allocator.h>
@@ -30,6 +62,7 @@
 #include <libcamera/property_ids.h>
 #include <libcamera/request.h>
 #include <libcamera/stream.h>
+#include <lifecycle_msgs/msg/state.hpp>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -40,7 +73,6 @@
 #include <rcl_interfaces/msg/detail/parameter_descriptor__struct.hpp>
 #include <rcl_interfaces/msg/detail/set_parameters_result__struct.hpp>
 #include <rclcpp/logging.hpp>
-#include <rclcpp/node.hpp>
 #include <rclcpp/node_interfaces/node_parameters_interface.hpp>
 #include <rclcpp/parameter.hpp>
 #include <rclcpp/parameter_value.hpp>
@@ -48,16 +80,26 @@
 #include <rclcpp/qos_event.hpp>
 #include <rclcpp/time.hpp>
 #include <rclcpp_components/register_node_macro.hpp>
+#include <rclcpp_lifecycle/lifecycle_node.hpp>
+#include <rclcpp_lifecycle/lifecycle_publisher.hpp>
+#include <rclcpp_lifecycle/state.hpp>
 #include <sensor_msgs/msg/detail/camera_info__struct.hpp>
 #include <sensor_msgs/msg/detail/compressed_image__struct.hpp>
+#include <sensor_msgs/image_encodings.hpp>
 #include <sensor_msgs/msg/detail/image__struct.hpp>
 #include <std_msgs/msg/detail/header__struct.hpp>
+#include <std_srvs/srv/set_bool.hpp>
+#include <std_srvs/srv/trigger.hpp>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <sys/mman.h>
+#include <thread>
 #include <tuple>
 #include <type_traits>
+#include <unistd.h>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 namespace rclcpp
@@ -68,16 +110,44 @@ class NodeOptions;
 
 namespace camera
 {
-class CameraNode : public rclcpp::Node
+// The camera is acquired, configured and its buffers are allocated on 'configure'.
+// Streaming starts on 'activate' and stops on 'deactivate', keeping the buffers.
+// The default node runs through both transitions on construction.
+class CameraNode : public rclcpp_lifecycle::LifecycleNode
 {
 public:
   explicit CameraNode(const rclcpp::NodeOptions &options);
 
   ~CameraNode();
 
+protected:
+  CameraNode(const rclcpp::NodeOptions &options, const bool autostart);
+
+  CallbackReturn
+  on_configure(const rclcpp_lifecycle::State &state) override;
+
+  CallbackReturn
+  on_activate(const rclcpp_lifecycle::State &state) override;
+
+  CallbackReturn
+  on_deactivate(const rclcpp_lifecycle::State &state) override;
+
+  CallbackReturn
+  on_cleanup(const rclcpp_lifecycle::State &state) override;
+
+  CallbackReturn
+  on_shutdown(const rclcpp_lifecycle::State &state) override;
+
+  CallbackReturn
+  on_error(const rclcpp_lifecycle::State &state) override;
+
 private:
-  libcamera::CameraManager camera_manager;
+  std::unique_ptr<libcamera::CameraManager> camera_manager;
   std::shared_ptr<libcamera::Camera> camera;
+  // applied configuration, restored when a reconfiguration fails
+  std::unique_ptr<libcamera::CameraConfiguration> config;
+  // the stream could neither be reconfigured nor restored
+  bool stream_lost = false;
   libcamera::Stream *stream;
   std::shared_ptr<libcamera::FrameBufferAllocator> allocator;
   std::vector<std::unique_ptr<libcamera::Request>> requests;
@@ -93,33 +163,287 @@ private:
   // timestamp offset (ns) from camera time to system time
   int64_t time_offset = 0;
 
-  rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr pub_image;
-  rclcpp::Publisher<sensor_msgs::msg::CompressedImage>::SharedPtr pub_image_compressed;
-  rclcpp::Publisher<sensor_msgs::msg::CameraInfo>::SharedPtr pub_ci;
+  rclcpp_lifecycle::LifecyclePublisher<sensor_msgs::msg::Image>::SharedPtr pub_image;
+  rclcpp_lifecycle::LifecyclePublisher<sensor_msgs::msg::CompressedImage>::SharedPtr
+    pub_image_compressed;
+  rclcpp_lifecycle::LifecyclePublisher<sensor_msgs::msg::CameraInfo>::SharedPtr pub_ci;
+  rclcpp_lifecycle::LifecyclePublisher<sensor_msgs::msg::Image>::SharedPtr pub_image_rect;
+  rclcpp_lifecycle::LifecyclePublisher<sensor_msgs::msg::Image>::SharedPtr pub_image_half;
+  rclcpp_lifecycle::LifecyclePublisher<sensor_msgs::msg::Image>::SharedPtr pub_image_quarter;
+  rclcpp_lifecycle::LifecyclePublisher<camera_ros::msg::ImageStatistics>::SharedPtr pub_statistics;
+  rclcpp_lifecycle::LifecyclePublisher<camera_ros::msg::FrameMetadata>::SharedPtr pub_metadata;
+  rclcpp_lifecycle::LifecyclePublisher<camera_ros::msg::ControlDescriptors>::SharedPtr
+    pub_metadata_descriptors;
+  // names and types of the control ids of the configured camera, published once per activation
+  camera_ros::msg::ControlDescriptors metadata_descriptors;
+  // index of the descriptor of a control id
+  std::unordered_map<unsigned int, std::size_t> metadata_index;
+  // metadata message reused for every frame, its arrays keep their capacity
+  camera_ros::msg::FrameMetadata metadata_msg;
 
   camera_info_manager::CameraInfoManager cim;
 
-  OnSetParametersCallbackHandle::SharedPtr callback_parameter_change;
+  // decimation and rate limit of the raw and compressed image
+  RateLimit rate_raw;
+  RateLimit rate_compressed;
+
+  // shed processing work when it exceeds the frame period
+  LoadShedding load_shedding;
+  uint8_t load_shedding_level = LoadShedding::NONE;
+  int64_t timestamp_prev = 0;
+
+  diagnostic_updater::Updater diagnostics;
+
+  // scheduling of the capture callback and the processing threads
+  ThreadScheduling scheduling_capture;
+  ThreadScheduling scheduling_processing;
+  std::atomic<bool> scheduling_failed = false;
+  std::thread::id capture_thread;
+  // age of a frame in the capture callback, from the start of the exposure, including the
+  // sensor readout, the ISP and the wakeup of the callback thread
+  LatencyMonitor frame_age;
+
+  // worker threads for parallel processing within a frame
+  std::unique_ptr<WorkerPool> workers;
+
+  // JPEG encoder quality and number of concurrently encoded strips (0: OpenCV encoder)
+  std::atomic<int> jpeg_quality = 95;
+  std::atomic<int> jpeg_strips = 0;
+  // average JPEG encoding latency (ms)
+  std::atomic<double> jpeg_latency = 0;
+  // JPEG quality control towards a bitrate or frame size target
+  QualityControl jpeg_rate;
+
+  // frame-parallel JPEG encoding, published in sequence order
+  std::unique_ptr<OrderedWorkers> jpeg_workers;
+
+  // lossless LZ4 compression of raw images instead of JPEG
+  std::atomic<bool> compress_lz4 = false;
+  std::atomic<bool> compress_delta = true;
+
+  // rectification of raw images with the calibration, tables are updated in the capture thread
+  std::atomic<bool> rectify = false;
+  RectificationMap rectification;
+
+  // distance (pixels) of the samples for image statistics
+  std::atomic<int64_t> statistics_grid = 16;
+
+  // suppression of frames without scene change, the detector runs in the capture thread
+  ChangeDetector change_detector;
+  std::atomic<double> change_threshold = 0;
+  std::atomic<double> change_block_threshold = 0.02;
+  std::atomic<double> change_heartbeat = 1;
+  // timestamp of the last frame that passed the detector
+  int64_t change_passed = 0;
+  // fraction of changed blocks and detection time (ms) per frame
+  std::atomic<double> change_last = 0;
+  std::atomic<double> change_cost = 0;
+  std::atomic<double> change_cost_max = 0;
+  std::atomic<uint64_t> change_suppressed = 0;
+
+  // huge pages and locking of frame buffers
+  HugePages huge_pages = HugePages::NONE;
+  bool memory_lock = false;
+  // page faults and TLB misses per frame in the capture thread
+  std::atomic<double> page_faults = 0;
+  std::atomic<double> tlb_misses = 0;
+
+  // kernel for copying from the mapped buffers, selected once by benchmark if empty
+  std::string copy_kernel;
+
+  // ring of the most recent frames, dumped to disk on request
+  std::unique_ptr<FrameRing> pretrigger;
+  std::atomic<bool> pretrigger_compress = false;
+  // compressed frame, reused by the capture callback
+  std::vector<uint8_t> pretrigger_buffer;
+  rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr srv_pretrigger_dump;
+  std::thread pretrigger_dump;
+  std::atomic<bool> pretrigger_dumping = false;
+  std::atomic<bool> pretrigger_stop = false;
+
+  // direct-to-disk recording of raw frames
+  std::unique_ptr<FrameRecorder> recorder;
+  std::mutex recorder_lock;
+  rclcpp::Service<std_srvs::srv::SetBool>::SharedPtr srv_record;
+
+  // replay of a frame file instead of the camera
+  std::unique_ptr<FrameFileReader> replay;
+  std::thread replay_thread;
+  std::atomic<bool> replay_stop = false;
+
+  // regions of interest, cropped from the mapped buffer and published on '~/roi_<i>/image_raw'
+  std::vector<sensor_msgs::msg::RegionOfInterest> regions;
+  std::vector<rclcpp_lifecycle::LifecyclePublisher<sensor_msgs::msg::Image>::SharedPtr> pub_regions;
+  // crop of the sensor area reported by the last frame
+  libcamera::Rectangle scaler_crop;
+  std::mutex regions_lock;
+  rclcpp::Service<camera_ros::srv::SetRegions>::SharedPtr srv_regions;
+
+  rclcpp::node_interfaces::OnSetParametersCallbackHandle::SharedPtr callback_parameter_change;
+  // the control parameters are declared once, by the first camera
+  bool controls_declared = false;
 
   // map parameter names to libcamera control id
   std::unordered_map<std::string, const libcamera::ControlId *> parameter_ids;
+  // names of the declared control parameters, also while no camera is configured
+  std::unordered_set<std::string> control_parameters;
   // parameters that are to be set for every request
   std::unordered_map<unsigned int, libcamera::ControlValue> parameters;
   // keep track of set parameters
   ParameterMap parameters_full;
   std::mutex parameters_lock;
 
+  // controls from the control topic, staged for the request of their target sequence
+  struct control_command_t
+  {
+    uint64_t sequence;
+    unsigned int id;
+    libcamera::ControlValue value;
+    std::chrono::steady_clock::time_point received;
+  };
+  std::vector<control_command_t> control_commands;
+  // applied controls, waiting for the metadata to report their values
+  std::vector<control_command_t> control_commands_applied;
+  std::mutex control_commands_lock;
+  uint64_t sequence_last = 0;
+  rclcpp::Subscription<camera_ros::msg::Controls>::SharedPtr sub_controls;
+  // time from receiving a control to the first frame with its value
+  LatencyMonitor control_latency;
+  std::atomic<uint64_t> control_unmatched = 0;
+
+  // requested frame rate and available modes for sensor mode selection
+  double fps = 0;
+  std::vector<SensorMode> sensor_modes;
+
+  std::vector<SensorMode>
+  probeSensorModes(const libcamera::StreamRole role);
+
+  std::tuple<std::unique_ptr<libcamera::CameraConfiguration>,
+             libcamera::CameraConfiguration::Status>
+  generateConfiguration(const libcamera::StreamRole role, const std::string &format,
+                        const libcamera::Size &size);
+
+  void
+  applyConfiguration(libcamera::CameraConfiguration *cfg);
+
+  void
+  allocateBuffers();
+
+  void
+  releaseBuffers();
+
   void
-  declareParameters();
+  startStreaming();
+
+  void
+  stopStreaming();
+
+  void
+  releaseCamera();
+
+  rcl_interfaces::msg::SetParametersResult
+  reconfigureStream(const std::vector<rclcpp::Parameter> &parameters);
+
+  void
+  declareControls();
+
+  void
+  registerParameterCallback();
+
+  void
+  deactivatePublishers();
 
   void
   requestComplete(libcamera::Request *request);
 
+  // publish, compress and record a frame from the camera or replay
+  void
+  processFrame(const FrameIndexEntry &frame, const uint8_t *data, const FormatType type);
+
+  void
+  replayFrames();
+
+  void
+  applyScheduling(const ThreadScheduling &scheduling, const std::string &name);
+
+  void
+  diagnoseScheduling(diagnostic_updater::DiagnosticStatusWrapper &status);
+
+  void
+  diagnoseMemory(diagnostic_updater::DiagnosticStatusWrapper &status);
+
+  void
+  selectCopyKernel(const uint8_t *data, const std::size_t size);
+
+  void
+  onControls(const camera_ros::msg::Controls::ConstSharedPtr msg);
+
+  void
+  measureControlLatency(const libcamera::ControlList &metadata);
+
+  void
+  diagnoseControls(diagnostic_updater::DiagnosticStatusWrapper &status);
+
+  void
+  describeMetadata();
+
+  void
+  publishMetadata(const libcamera::ControlList &metadata, const FrameIndexEntry &frame);
+
   rcl_interfaces::msg::SetParametersResult
   onParameterChange(const std::vector<rclcpp::Parameter> &parameters);
+
+  void
+  encodeJpeg(const sensor_msgs::msg::Image &image, sensor_msgs::msg::CompressedImage &msg);
+
+  void
+  diagnoseLoad(diagnostic_updater::DiagnosticStatusWrapper &status);
+
+  void
+  onDumpPretrigger(const std::shared_ptr<std_srvs::srv::Trigger::Request> request,
+                   std::shared_ptr<std_srvs::srv::Trigger::Response> response);
+
+  void
+  dumpPretrigger(std::unique_ptr<FrameFileWriter> writer, const int64_t end);
+
+  void
+  diagnosePretrigger(diagnostic_updater::DiagnosticStatusWrapper &status);
+
+  void
+  onRecord(const std::shared_ptr<std_srvs::srv::SetBool::Request> request,
+           std::shared_ptr<std_srvs::srv::SetBool::Response> response);
+
+  void
+  diagnoseRecorder(diagnostic_updater::DiagnosticStatusWrapper &status);
+
+  void
+  publishStatistics(const std_msgs::msg::Header &hdr, const FrameIndexEntry &frame,
+                    const uint8_t *data, const FormatType type);
+
+  bool
+  detectChange(const FrameIndexEntry &frame, const uint8_t *data, const FormatType type);
+
+  void
+  diagnoseChange(diagnostic_updater::DiagnosticStatusWrapper &status);
+
+  void
+  onSetRegions(const std::shared_ptr<camera_ros::srv::SetRegions::Request> request,
+               std::shared_ptr<camera_ros::srv::SetRegions::Response> response);
+
+  void
+  setScalerCrop(const std::vector<sensor_msgs::msg::RegionOfInterest> &regions,
+                camera_ros::srv::SetRegions::Response &response);
+};
+
+// lifecycle variant that waits for the 'configure' and 'activate' transitions
+class CameraLifecycleNode : public CameraNode
+{
+public:
+  explicit CameraLifecycleNode(const rclcpp::NodeOptions &options) : CameraNode(options, false) {}
 };
 
 RCLCPP_COMPONENTS_REGISTER_NODE(camera::CameraNode)
+RCLCPP_COMPONENTS_REGISTER_NODE(camera::CameraLifecycleNode)
 
 
 libcamera::StreamRole
@@ -140,94 +464,690 @@ get_role(const std::string &role)
   }
 }
 
-CameraNode::CameraNode(const rclcpp::NodeOptions &options) : Node("camera", options), cim(this)
+CameraNode::CameraNode(const rclcpp::NodeOptions &options) : CameraNode(options, true) {}
+
+CameraNode::CameraNode(const rclcpp::NodeOptions &options, const bool autostart)
+    : LifecycleNode("camera", options), cim(this), diagnostics(this)
 {
   // pixel format
   rcl_interfaces::msg::ParameterDescriptor param_descr_format;
   param_descr_format.description = "pixel format of streaming buffer";
-  param_descr_format.read_only = true;
   declare_parameter<std::string>("format", {}, param_descr_format);
 
   // stream role
   rcl_interfaces::msg::ParameterDescriptor param_descr_role;
   param_descr_role.description = "stream role";
   param_descr_role.additional_constraints = "one of {raw, still, video, viewfinder}";
-  param_descr_role.read_only = true;
   declare_parameter<std::string>("role", "video", param_descr_role);
 
   // image dimensions
+  rcl_interfaces::msg::ParameterDescriptor param_descr_size;
+  param_descr_size.description = "image dimensions, changing them reconfigures the stream";
+  param_descr_size.additional_constraints =
+    "set 'width' and 'height' together in one request, sizes adjusted by the camera are rejected";
+  declare_parameter<int64_t>("width", {}, param_descr_size);
+  declare_parameter<int64_t>("height", {}, param_descr_size);
+
   rcl_interfaces::msg::ParameterDescriptor param_descr_ro;
   param_descr_ro.read_only = true;
-  declare_parameter<int64_t>("width", {}, param_descr_ro);
-  declare_parameter<int64_t>("height", {}, param_descr_ro);
+
+  // frame rate for sensor mode selection
+  rcl_interfaces::msg::ParameterDescriptor param_descr_fps;
+  param_descr_fps.description = "requested frame rate (Hz) for sensor mode selection";
+  param_descr_fps.additional_constraints = "0 keeps the default sensor mode";
+  param_descr_fps.read_only = true;
+  declare_parameter<double>("fps", 0, param_descr_fps);
 
   // camera ID
   declare_parameter("camera", rclcpp::ParameterValue {}, param_descr_ro.set__dynamic_typing(true));
 
+  // replay of a frame file instead of the camera
+  rcl_interfaces::msg::ParameterDescriptor param_descr_replay_file;
+  param_descr_replay_file.description = "frame file that is replayed instead of the camera";
+  param_descr_replay_file.additional_constraints = "empty uses the camera";
+  param_descr_replay_file.read_only = true;
+  declare_parameter<std::string>("replay.file", {}, param_descr_replay_file);
+
+  rcl_interfaces::msg::ParameterDescriptor param_descr_replay_rate;
+  param_descr_replay_rate.description = "replay speed relative to the recorded frame rate";
+  param_descr_replay_rate.additional_constraints = "0 replays as fast as possible";
+  param_descr_replay_rate.floating_point_range = {rcl_interfaces::msg::FloatingPointRange()
+                                                    .set__from_value(0)
+                                                    .set__to_value(1000)
+                                                    .set__step(0)};
+  declare_parameter<double>("replay.rate", 1, param_descr_replay_rate);
+
+  rcl_interfaces::msg::ParameterDescriptor param_descr_replay_loop;
+  param_descr_replay_loop.description = "restart the replay at the end of the file";
+  declare_parameter<bool>("replay.loop", false, param_descr_replay_loop);
+
+  // decimation and rate limit per image topic, checked before copying or encoding a frame
+  for (const std::string &topic : {"raw", "compressed"}) {
+    rcl_interfaces::msg::ParameterDescriptor param_descr_decimation;
+    param_descr_decimation.description = "publish every n-th " + topic + " image";
+    param_descr_decimation.integer_range = {rcl_interfaces::msg::IntegerRange()
+                                              .set__from_value(1)
+                                              .set__to_value(std::numeric_limits<int64_t>::max())
+                                              .set__step(1)};
+    declare_parameter<int64_t>(topic + ".decimation", 1, param_descr_decimation);
+
+    rcl_interfaces::msg::ParameterDescriptor param_descr_max_rate;
+    param_descr_max_rate.description = "maximum publishing rate (Hz) of the " + topic + " image";
+    param_descr_max_rate.additional_constraints = "0 disables the rate limit";
+    param_descr_max_rate.floating_point_range = {rcl_interfaces::msg::FloatingPointRange()
+                                                   .set__from_value(0)
+                                                   .set__to_value(1000)
+                                                   .set__step(0)};
+    declare_parameter<double>(topic + ".max_rate", 0, param_descr_max_rate);
+  }
+  rate_raw.set_decimation(get_parameter("raw.decimation").as_int());
+  rate_raw.set_max_rate(get_parameter("raw.max_rate").as_double());
+  rate_compressed.set_decimation(get_parameter("compressed.decimation").as_int());
+  rate_compressed.set_max_rate(get_parameter("compressed.max_rate").as_double());
+
+  // compression of raw images
+  rcl_interfaces::msg::ParameterDescriptor param_descr_codec;
+  param_descr_codec.description =
+    "compression of raw images, 'lz4' publishes lossless images with format \"<encoding>; lz4\" "
+    "or \"<encoding>; lz4 delta\"";
+  param_descr_codec.additional_constraints = "one of {jpeg, lz4}";
+  declare_parameter<std::string>("compressed.codec", "jpeg", param_descr_codec);
+
+  rcl_interfaces::msg::ParameterDescriptor param_descr_delta;
+  param_descr_delta.description = "per-row delta prediction for lossless compression";
+  declare_parameter<bool>("compressed.delta", true, param_descr_delta);
+
+  const std::string codec = get_parameter("compressed.codec").as_string();
+  if (codec != "jpeg" && codec != "lz4")
+    throw std::runtime_error("invalid codec: \"" + codec + "\"");
+  compress_lz4 = codec == "lz4";
+  compress_delta = get_parameter("compressed.delta").as_bool();
+
+  // rectified images on '~/image_rect'
+  rcl_interfaces::msg::ParameterDescriptor param_descr_rectify;
+  param_descr_rectify.description =
+    "publish raw images rectified with the camera calibration on '~/image_rect'";
+  declare_parameter<bool>("rectify", false, param_descr_rectify);
+  rectify = get_parameter("rectify").as_bool();
+
+  // image statistics on '~/statistics'
+  rcl_interfaces::msg::ParameterDescriptor param_descr_statistics_grid;
+  param_descr_statistics_grid.description =
+    "distance (pixels) of the samples for the image statistics on '~/statistics'";
+  param_descr_statistics_grid.integer_range = {
+    rcl_interfaces::msg::IntegerRange().set__from_value(1).set__to_value(256).set__step(1)};
+  declare_parameter<int64_t>("statistics.grid", 16, param_descr_statistics_grid);
+  statistics_grid = get_parameter("statistics.grid").as_int();
+
+  // change detection on the raw buffer
+  rcl_interfaces::msg::ParameterDescriptor param_descr_change_threshold;
+  param_descr_change_threshold.description =
+    "fraction of changed blocks below which frames are not published";
+  param_descr_change_threshold.additional_constraints = "0 disables the change detection";
+  param_descr_change_threshold.floating_point_range = {
+    rcl_interfaces::msg::FloatingPointRange().set__from_value(0).set__to_value(1)};
+  declare_parameter<double>("change.threshold", 0, param_descr_change_threshold);
+
+  rcl_interfaces::msg::ParameterDescriptor param_descr_change_block;
+  param_descr_change_block.description =
+    "change of the mean of a block, as fraction of the sample range, for a changed block";
+  param_descr_change_block.floating_point_range = {
+    rcl_interfaces::msg::FloatingPointRange().set__from_value(0).set__to_value(1)};
+  declare_parameter<double>("change.block_threshold", 0.02, param_descr_change_block);
+
+  rcl_interfaces::msg::ParameterDescriptor param_descr_change_heartbeat;
+  param_descr_change_heartbeat.description =
+    "period (s) of frames that are published without change, 0 suppresses all of them";
+  declare_parameter<double>("change.heartbeat", 1, param_descr_change_heartbeat);
+
+  change_threshold = get_parameter("change.threshold").as_double();
+  change_block_threshold = get_parameter("change.block_threshold").as_double();
+  change_heartbeat = get_parameter("change.heartbeat").as_double();
+
+  // real-time scheduling and CPU affinity of the capture callback and processing threads
+  for (const std::string &group : {"capture", "processing"}) {
+    rcl_interfaces::msg::ParameterDescriptor param_descr_policy;
+    param_descr_policy.description = "scheduling policy of the " + group + " threads";
+    param_descr_policy.additional_constraints =
+      "one of {keep, other, fifo, rr}, 'keep' keeps the inherited policy and priority";
+    param_descr_policy.read_only = true;
+    declare_parameter<std::string>("scheduling." + group + ".policy", "keep", param_descr_policy);
+
+    rcl_interfaces::msg::ParameterDescriptor param_descr_priority;
+    param_descr_priority.description =
+      "static priority of the " + group + " threads with a real-time policy";
+    param_descr_priority.integer_range = {
+      rcl_interfaces::msg::IntegerRange().set__from_value(1).set__to_value(99).set__step(1)};
+    param_descr_priority.read_only = true;
+    declare_parameter<int64_t>("scheduling." + group + ".priority", 1, param_descr_priority);
+
+    rcl_interfaces::msg::ParameterDescriptor param_descr_cpus;
+    param_descr_cpus.description = "CPUs that the " + group + " threads are allowed to run on";
+    param_descr_cpus.additional_constraints = "empty keeps the inherited affinity";
+    param_descr_cpus.read_only = true;
+    declare_parameter<std::vector<int64_t>>("scheduling." + group + ".cpus", {},
+                                            param_descr_cpus);
+  }
+
+  const auto get_scheduling = [this](const std::string &group) {
+    ThreadScheduling scheduling;
+    scheduling.policy =
+      get_sched_policy(get_parameter("scheduling." + group + ".policy").as_string());
+    scheduling.priority = get_parameter("scheduling." + group + ".priority").as_int();
+    for (const int64_t cpu : get_parameter("scheduling." + group + ".cpus").as_integer_array())
+      scheduling.cpus.push_back(cpu);
+    return scheduling;
+  };
+  scheduling_capture = get_scheduling("capture");
+  scheduling_processing = get_scheduling("processing");
+  const auto init_processing = [this]() { applyScheduling(scheduling_processing, "processing"); };
+
+  // worker threads
+  rcl_interfaces::msg::ParameterDescriptor param_descr_threads;
+  param_descr_threads.description = "number of worker threads for processing a frame";
+  param_descr_threads.additional_constraints = "0 uses one thread per core";
+  param_descr_threads.read_only = true;
+  declare_parameter<int64_t>("processing_threads", 0, param_descr_threads);
+  const int64_t threads = get_parameter("processing_threads").as_int();
+  workers = std::make_unique<WorkerPool>(
+    threads > 0 ? threads - 1 : std::max<int64_t>(std::thread::hardware_concurrency(), 1) - 1,
+    init_processing);
+
+  // JPEG encoder
+  rcl_interfaces::msg::ParameterDescriptor param_descr_jpeg_quality;
+  param_descr_jpeg_quality.description = "JPEG quality of the strip encoder";
+  param_descr_jpeg_quality.integer_range = {
+    rcl_interfaces::msg::IntegerRange().set__from_value(1).set__to_value(100).set__step(1)};
+  declare_parameter<int64_t>("jpeg.quality", 95, param_descr_jpeg_quality);
+
+  rcl_interfaces::msg::ParameterDescriptor param_descr_jpeg_strips;
+  param_descr_jpeg_strips.description =
+    "number of horizontal strips of a frame encoded concurrently and joined by restart markers";
+  param_descr_jpeg_strips.additional_constraints = "0 encodes the whole frame with OpenCV";
+  param_descr_jpeg_strips.integer_range = {
+    rcl_interfaces::msg::IntegerRange().set__from_value(0).set__to_value(256).set__step(1)};
+  declare_parameter<int64_t>("jpeg.strips", 0, param_descr_jpeg_strips);
+
+  rcl_interfaces::msg::ParameterDescriptor param_descr_jpeg_bitrate;
+  param_descr_jpeg_bitrate.description =
+    "target bitrate (bytes/s) of the JPEG quality control of the strip encoder";
+  param_descr_jpeg_bitrate.additional_constraints = "0 disables the bitrate target";
+  declare_parameter<double>("jpeg.target_bitrate", 0, param_descr_jpeg_bitrate);
+
+  rcl_interfaces::msg::ParameterDescriptor param_descr_jpeg_size;
+  param_descr_jpeg_size.description =
+    "target size (bytes/frame) of the JPEG quality control of the strip encoder";
+  param_descr_jpeg_size.additional_constraints = "0 disables the size target";
+  declare_parameter<int64_t>("jpeg.target_size", 0, param_descr_jpeg_size);
+
+  rcl_interfaces::msg::ParameterDescriptor param_descr_jpeg_bounds;
+  param_descr_jpeg_bounds.description = "JPEG quality bounds of the quality control";
+  param_descr_jpeg_bounds.integer_range = {
+    rcl_interfaces::msg::IntegerRange().set__from_value(1).set__to_value(100).set__step(1)};
+  declare_parameter<int64_t>("jpeg.quality_min", 10, param_descr_jpeg_bounds);
+  declare_parameter<int64_t>("jpeg.quality_max", 95, param_descr_jpeg_bounds);
+
+  jpeg_quality = get_parameter("jpeg.quality").as_int();
+  jpeg_strips = get_parameter("jpeg.strips").as_int();
+  jpeg_rate.set_target_bitrate(get_parameter("jpeg.target_bitrate").as_double());
+  jpeg_rate.set_target_size(get_parameter("jpeg.target_size").as_int());
+  jpeg_rate.set_bounds(get_parameter("jpeg.quality_min").as_int(),
+                       get_parameter("jpeg.quality_max").as_int());
+
+  // frame-parallel JPEG encoding
+  rcl_interfaces::msg::ParameterDescriptor param_descr_jpeg_threads;
+  param_descr_jpeg_threads.description =
+    "number of threads encoding consecutive raw images to JPEG in parallel";
+  param_descr_jpeg_threads.additional_constraints = "0 encodes in the capture callback";
+  param_descr_jpeg_threads.read_only = true;
+  declare_parameter<int64_t>("jpeg.threads", 0, param_descr_jpeg_threads);
+
+  rcl_interfaces::msg::ParameterDescriptor param_descr_jpeg_window;
+  param_descr_jpeg_window.description =
+    "maximum number of images in encoding, further images are not compressed";
+  param_descr_jpeg_window.additional_constraints = "0 uses twice the number of threads";
+  param_descr_jpeg_window.read_only = true;
+  declare_parameter<int64_t>("jpeg.window", 0, param_descr_jpeg_window);
+
+  const int64_t jpeg_threads = get_parameter("jpeg.threads").as_int();
+  const int64_t jpeg_window = get_parameter("jpeg.window").as_int();
+  if (jpeg_threads > 0)
+    jpeg_workers = std::make_unique<OrderedWorkers>(
+      jpeg_threads, jpeg_window > 0 ? jpeg_window : 2 * jpeg_threads, init_processing);
+
+  // adaptive load shedding
+  rcl_interfaces::msg::ParameterDescriptor param_descr_shedding;
+  param_descr_shedding.description = "shed compression, decompression and raw images in this "
+                                     "order when processing exceeds the frame period";
+  declare_parameter<bool>("load_shedding.enable", false, param_descr_shedding);
+
+  rcl_interfaces::msg::ParameterDescriptor param_descr_budget;
+  param_descr_budget.description = "fraction of the frame period available for processing";
+  param_descr_budget.floating_point_range = {rcl_interfaces::msg::FloatingPointRange()
+                                               .set__from_value(0.1)
+                                               .set__to_value(1)
+                                               .set__step(0)};
+  declare_parameter<double>("load_shedding.budget", 0.9, param_descr_budget);
+  load_shedding.set_enabled(get_parameter("load_shedding.enable").as_bool());
+  load_shedding.set_budget(get_parameter("load_shedding.budget").as_double());
+
+  // memory of frame buffers
+  rcl_interfaces::msg::ParameterDescriptor param_descr_huge_pages;
+  param_descr_huge_pages.description =
+    "huge pages for the frame buffers of the pre-trigger ring and recorder";
+  param_descr_huge_pages.additional_constraints = "one of {none, transparent, explicit}";
+  param_descr_huge_pages.read_only = true;
+  declare_parameter<std::string>("memory.huge_pages", "none", param_descr_huge_pages);
+
+  rcl_interfaces::msg::ParameterDescriptor param_descr_memory_lock;
+  param_descr_memory_lock.description = "lock the memory of the node in RAM";
+  param_descr_memory_lock.read_only = true;
+  declare_parameter<bool>("memory.lock", false, param_descr_memory_lock);
+
+  rcl_interfaces::msg::ParameterDescriptor param_descr_copy_kernel;
+  param_descr_copy_kernel.description = "kernel for copying frames from the camera buffers";
+  param_descr_copy_kernel.additional_constraints =
+    "one of {auto, memcpy, sse4.1, avx2, neon} as supported by the CPU, 'auto' selects the "
+    "fastest kernel on the first camera buffer";
+  param_descr_copy_kernel.read_only = true;
+  declare_parameter<std::string>("memory.copy_kernel", "auto", param_descr_copy_kernel);
+
+  if (get_parameter("memory.copy_kernel").as_string() != "auto") {
+    copy_kernel = get_parameter("memory.copy_kernel").as_string();
+    set_copy_kernel(get_copy_kernel(copy_kernel));
+  }
+
+  huge_pages = get_huge_pages(get_parameter("memory.huge_pages").as_string());
+  memory_lock = get_parameter("memory.lock").as_bool();
+  if (huge_pages != HugePages::NONE || memory_lock) {
+    // reuse the heap pages of previous message buffers instead of faulting in new ones
+    retain_heap_memory();
+  }
+  if (memory_lock) {
+    try {
+      lock_memory();
+    }
+    catch (const std::runtime_error &e) {
+      RCLCPP_WARN_STREAM(get_logger(), e.what());
+    }
+  }
+
+  // pre-trigger ring of recent frames
+  rcl_interfaces::msg::ParameterDescriptor param_descr_pretrigger_size;
+  param_descr_pretrigger_size.description =
+    "capacity (bytes) of the ring of recent frames that is dumped by '~/pretrigger/dump'";
+  param_descr_pretrigger_size.additional_constraints = "0 disables the ring";
+  param_descr_pretrigger_size.read_only = true;
+  declare_parameter<int64_t>("pretrigger.size", 0, param_descr_pretrigger_size);
+
+  rcl_interfaces::msg::ParameterDescriptor param_descr_pretrigger_compress;
+  param_descr_pretrigger_compress.description =
+    "store raw frames in the ring with lossless LZ4 delta compression";
+  declare_parameter<bool>("pretrigger.compress", false, param_descr_pretrigger_compress);
+
+  rcl_interfaces::msg::ParameterDescriptor param_descr_pretrigger_duration;
+  param_descr_pretrigger_duration.description =
+    "duration (s) of frames after the dump request that are appended to the dump";
+  declare_parameter<double>("pretrigger.duration", 5, param_descr_pretrigger_duration);
+
+  rcl_interfaces::msg::ParameterDescriptor param_descr_pretrigger_directory;
+  param_descr_pretrigger_directory.description = "directory of the dumped frame files";
+  declare_parameter<std::string>("pretrigger.directory", "/tmp", param_descr_pretrigger_directory);
+
+  // the number of frames is bounded to keep the index preallocated
+  const int64_t pretrigger_size = get_parameter("pretrigger.size").as_int();
+  if (pretrigger_size > 0) {
+    pretrigger = std::make_unique<FrameRing>(pretrigger_size, 4096, huge_pages, memory_lock);
+    srv_pretrigger_dump = create_service<std_srvs::srv::Trigger>(
+      "~/pretrigger/dump", std::bind(&CameraNode::onDumpPretrigger, this, std::placeholders::_1,
+                                     std::placeholders::_2));
+  }
+  pretrigger_compress = get_parameter("pretrigger.compress").as_bool();
+
+  // recorder, started and stopped by '~/record'
+  rcl_interfaces::msg::ParameterDescriptor param_descr_record_directory;
+  param_descr_record_directory.description = "directory of the recorded segment files";
+  declare_parameter<std::string>("record.directory", "/tmp", param_descr_record_directory);
+
+  rcl_interfaces::msg::ParameterDescriptor param_descr_record_segment;
+  param_descr_record_segment.description = "preallocated size (bytes) of a segment file";
+  param_descr_record_segment.integer_range = {rcl_interfaces::msg::IntegerRange()
+                                                .set__from_value(1 << 20)
+                                                .set__to_value(std::numeric_limits<int64_t>::max())
+                                                .set__step(1)};
+  declare_parameter<int64_t>("record.segment_size", int64_t(1) << 30, param_descr_record_segment);
+
+  rcl_interfaces::msg::ParameterDescriptor param_descr_record_buffers;
+  param_descr_record_buffers.description =
+    "number of frames buffered for writing, further frames are dropped";
+  param_descr_record_buffers.integer_range = {
+    rcl_interfaces::msg::IntegerRange().set__from_value(1).set__to_value(1024).set__step(1)};
+  declare_parameter<int64_t>("record.buffers", 16, param_descr_record_buffers);
+
+  srv_record = create_service<std_srvs::srv::SetBool>(
+    "~/record",
+    std::bind(&CameraNode::onRecord, this, std::placeholders::_1, std::placeholders::_2));
+
+  srv_regions = create_service<camera_ros::srv::SetRegions>(
+    "~/set_regions",
+    std::bind(&CameraNode::onSetRegions, this, std::placeholders::_1, std::placeholders::_2));
+
+  diagnostics.setHardwareID("none");
+  diagnostics.add("load shedding", this, &CameraNode::diagnoseLoad);
+  if (pretrigger)
+    diagnostics.add("pre-trigger ring", this, &CameraNode::diagnosePretrigger);
+  diagnostics.add("recorder", this, &CameraNode::diagnoseRecorder);
+  diagnostics.add("scheduling", this, &CameraNode::diagnoseScheduling);
+  diagnostics.add("memory", this, &CameraNode::diagnoseMemory);
+  diagnostics.add("controls", this, &CameraNode::diagnoseControls);
+  diagnostics.add("change detection", this, &CameraNode::diagnoseChange);
+
   // publisher for raw and compressed image
   pub_image = this->create_publisher<sensor_msgs::msg::Image>("~/image_raw", 1);
   pub_image_compressed =
     this->create_publisher<sensor_msgs::msg::CompressedImage>("~/image_raw/compressed", 1);
   pub_ci = this->create_publisher<sensor_msgs::msg::CameraInfo>("~/camera_info", 1);
+  pub_image_rect = this->create_publisher<sensor_msgs::msg::Image>("~/image_rect", 1);
+  pub_image_half = this->create_publisher<sensor_msgs::msg::Image>("~/image_raw/half", 1);
+  pub_image_quarter = this->create_publisher<sensor_msgs::msg::Image>("~/image_raw/quarter", 1);
+  pub_statistics = this->create_publisher<camera_ros::msg::ImageStatistics>("~/statistics", 1);
+
+  // frame metadata with control ids, and their descriptors for latched subscribers
+  pub_metadata = this->create_publisher<camera_ros::msg::FrameMetadata>("~/metadata", 1);
+  pub_metadata_descriptors = this->create_publisher<camera_ros::msg::ControlDescriptors>(
+    "~/metadata/descriptors", rclcpp::QoS(1).transient_local());
+
+  // controls for the next requests, without the parameter interface
+  sub_controls = this->create_subscription<camera_ros::msg::Controls>(
+    "~/controls", 10, std::bind(&CameraNode::onControls, this, std::placeholders::_1));
+
+  if (autostart) {
+    // configure and start streaming immediately
+    if (configure().id() != lifecycle_msgs::msg::State::PRIMARY_STATE_INACTIVE)
+      throw std::runtime_error("failed to configure camera");
+    if (activate().id() != lifecycle_msgs::msg::State::PRIMARY_STATE_ACTIVE)
+      throw std::runtime_error("failed to activate camera");
+  }
+}
 
-  // start camera manager and check for cameras
-  camera_manager.start();
-  if (camera_manager.cameras().empty())
-    throw std::runtime_error("no cameras available");
-
-  // get the camera
-  switch (get_parameter("camera").get_type()) {
-  case rclcpp::ParameterType::PARAMETER_NOT_SET:
-    // use first camera as default
-    camera = camera_manager.cameras().front();
-    RCLCPP_INFO_STREAM(get_logger(), camera_manager);
-    RCLCPP_WARN_STREAM(get_logger(),
-                       "no camera selected, using default: \"" << camera->id() << "\"");
-    break;
-  case rclcpp::ParameterType::PARAMETER_INTEGER:
+CameraNode::~CameraNode()
+{
+  pretrigger_stop = true;
+  if (pretrigger_dump.joinable())
+    pretrigger_dump.join();
+  recorder.reset();
+
+  // release the camera in any state, as there is no transition on destruction
+  const uint8_t state = get_current_state().id();
+  if (state == lifecycle_msgs::msg::State::PRIMARY_STATE_ACTIVE)
+    stopStreaming();
+  if (state == lifecycle_msgs::msg::State::PRIMARY_STATE_ACTIVE ||
+      state == lifecycle_msgs::msg::State::PRIMARY_STATE_INACTIVE)
+    releaseCamera();
+}
+
+CameraNode::CallbackReturn
+CameraNode::on_configure(const rclcpp_lifecycle::State &)
+{
+  // acquire, configure and allocate, without streaming
+  try {
+    // open the file instead of the camera
+    const std::string replay_file = get_parameter("replay.file").as_string();
+    if (!replay_file.empty()) {
+      replay = std::make_unique<FrameFileReader>(replay_file);
+      if (!replay->frames())
+        throw std::runtime_error("no frames in \"" + replay_file + "\"");
+      diagnostics.setHardwareID("replay");
+      describeMetadata();
+      set_parameter(rclcpp::Parameter("width", int64_t(replay->entry(0).width)));
+      set_parameter(rclcpp::Parameter("height", int64_t(replay->entry(0).height)));
+      // parameters that do not depend on the camera still apply to replayed frames
+      registerParameterCallback();
+      return CallbackReturn::SUCCESS;
+    }
+
+    // start camera manager and check for cameras
+    camera_manager = std::make_unique<libcamera::CameraManager>();
+    camera_manager->start();
+    if (camera_manager->cameras().empty())
+      throw std::runtime_error("no cameras available");
+
+    // get the camera
+    switch (get_parameter("camera").get_type()) {
+    case rclcpp::ParameterType::PARAMETER_NOT_SET:
+      // use first camera as default
+      camera = camera_manager->cameras().front();
+      RCLCPP_INFO_STREAM(get_logger(), *camera_manager);
+      RCLCPP_WARN_STREAM(get_logger(),
+                         "no camera selected, using default: \"" << camera->id() << "\"");
+      break;
+    case rclcpp::ParameterType::PARAMETER_INTEGER:
+    {
+      const size_t id = get_parameter("camera").as_int();
+      if (id >= camera_manager->cameras().size()) {
+        RCLCPP_INFO_STREAM(get_logger(), *camera_manager);
+        throw std::runtime_error("camera with id " + std::to_string(id) + " does not exist");
+      }
+      camera = camera_manager->cameras().at(id);
+      RCLCPP_DEBUG_STREAM(get_logger(), "found camera by id: " << id);
+    } break;
+    case rclcpp::ParameterType::PARAMETER_STRING:
+    {
+      const std::string name = get_parameter("camera").as_string();
+      camera = camera_manager->get(name);
+      if (!camera) {
+        RCLCPP_INFO_STREAM(get_logger(), *camera_manager);
+        throw std::runtime_error("camera with name " + name + " does not exist");
+      }
+      RCLCPP_DEBUG_STREAM(get_logger(), "found camera by name: \"" << name << "\"");
+    } break;
+    default:
+      RCLCPP_ERROR_STREAM(get_logger(), "unuspported camera parameter type: "
+                                          << get_parameter("camera").get_type_name());
+      break;
+    }
+
+    if (!camera)
+      throw std::runtime_error("failed to find camera");
+
+    diagnostics.setHardwareID(camera->id());
+    describeMetadata();
+
+    if (camera->acquire())
+      throw std::runtime_error("failed to acquire camera");
+
+    // probe sensor modes once, before the camera is configured for streaming
+    fps = get_parameter("fps").as_double();
+    if (fps > 0)
+      sensor_modes = probeSensorModes(get_role(get_parameter("role").as_string()));
+
+    // configure camera stream
+    std::unique_ptr<libcamera::CameraConfiguration> cfg;
+    std::tie(cfg, std::ignore) = generateConfiguration(
+      get_role(get_parameter("role").as_string()), get_parameter("format").as_string(),
+      libcamera::Size(get_parameter("width").as_int(), get_parameter("height").as_int()));
+
+    applyConfiguration(cfg.get());
+    config = std::move(cfg);
+
+    const libcamera::StreamConfiguration &scfg = config->at(0);
+    set_parameter(rclcpp::Parameter("width", int64_t(scfg.size.width)));
+    set_parameter(rclcpp::Parameter("height", int64_t(scfg.size.height)));
+    set_parameter(rclcpp::Parameter("format", scfg.pixelFormat.toString()));
+
+    // map control parameters to the ids of this camera
+    for (const auto &[id, info] : camera->controls())
+      parameter_ids[id->name()] = id;
+
+    // declare controls once, they are kept across 'cleanup' and 'configure'
+    if (!controls_declared)
+      declareControls();
+    registerParameterCallback();
+
+    // allocate stream buffers and create one request per buffer
+    allocateBuffers();
+  }
+  catch (const std::runtime_error &e) {
+    RCLCPP_ERROR_STREAM(get_logger(), e.what());
+    releaseCamera();
+    return CallbackReturn::FAILURE;
+  }
+
+  return CallbackReturn::SUCCESS;
+}
+
+CameraNode::CallbackReturn
+CameraNode::on_activate(const rclcpp_lifecycle::State &)
+{
+  pub_image->on_activate();
+  pub_image_compressed->on_activate();
+  pub_ci->on_activate();
+  pub_image_rect->on_activate();
+  pub_image_half->on_activate();
+  pub_image_quarter->on_activate();
+  pub_statistics->on_activate();
   {
-    const size_t id = get_parameter("camera").as_int();
-    if (id >= camera_manager.cameras().size()) {
-      RCLCPP_INFO_STREAM(get_logger(), camera_manager);
-      throw std::runtime_error("camera with id " + std::to_string(id) + " does not exist");
-    }
-    camera = camera_manager.cameras().at(id);
-    RCLCPP_DEBUG_STREAM(get_logger(), "found camera by id: " << id);
-  } break;
-  case rclcpp::ParameterType::PARAMETER_STRING:
+    std::lock_guard<std::mutex> guard(regions_lock);
+    for (const auto &pub : pub_regions)
+      pub->on_activate();
+  }
+  pub_metadata->on_activate();
+  pub_metadata_descriptors->on_activate();
+  pub_metadata_descriptors->publish(metadata_descriptors);
+
+  try {
+    startStreaming();
+  }
+  catch (const std::runtime_error &e) {
+    RCLCPP_ERROR_STREAM(get_logger(), e.what());
+    // the node stays inactive
+    if (camera)
+      camera->requestCompleted.disconnect();
+    deactivatePublishers();
+    return CallbackReturn::FAILURE;
+  }
+
+  return CallbackReturn::SUCCESS;
+}
+
+CameraNode::CallbackReturn
+CameraNode::on_deactivate(const rclcpp_lifecycle::State &)
+{
+  // stop streaming but keep the configuration and buffers
+  stopStreaming();
+  deactivatePublishers();
+
+  // the stream has no buffers after a failed reconfiguration
+  if (stream_lost)
+    return CallbackReturn::ERROR;
+
+  return CallbackReturn::SUCCESS;
+}
+
+void
+CameraNode::deactivatePublishers()
+{
+  pub_image->on_deactivate();
+  pub_image_compressed->on_deactivate();
+  pub_ci->on_deactivate();
+  pub_image_rect->on_deactivate();
+  pub_image_half->on_deactivate();
+  pub_image_quarter->on_deactivate();
+  pub_statistics->on_deactivate();
   {
-    const std::string name = get_parameter("camera").as_string();
-    camera = camera_manager.get(name);
-    if (!camera) {
-      RCLCPP_INFO_STREAM(get_logger(), camera_manager);
-      throw std::runtime_error("camera with name " + name + " does not exist");
-    }
-    RCLCPP_DEBUG_STREAM(get_logger(), "found camera by name: \"" << name << "\"");
-  } break;
-  default:
-    RCLCPP_ERROR_STREAM(get_logger(), "unuspported camera parameter type: "
-                                        << get_parameter("camera").get_type_name());
-    break;
+    std::lock_guard<std::mutex> guard(regions_lock);
+    for (const auto &pub : pub_regions)
+      pub->on_deactivate();
+  }
+  pub_metadata->on_deactivate();
+  pub_metadata_descriptors->on_deactivate();
+}
+
+CameraNode::CallbackReturn
+CameraNode::on_cleanup(const rclcpp_lifecycle::State &)
+{
+  releaseCamera();
+  return stream_lost ? CallbackReturn::ERROR : CallbackReturn::SUCCESS;
+}
+
+CameraNode::CallbackReturn
+CameraNode::on_shutdown(const rclcpp_lifecycle::State &state)
+{
+  if (state.id() == lifecycle_msgs::msg::State::PRIMARY_STATE_ACTIVE)
+    on_deactivate(state);
+  if (state.id() == lifecycle_msgs::msg::State::PRIMARY_STATE_ACTIVE ||
+      state.id() == lifecycle_msgs::msg::State::PRIMARY_STATE_INACTIVE)
+    on_cleanup(state);
+  return CallbackReturn::SUCCESS;
+}
+
+CameraNode::CallbackReturn
+CameraNode::on_error(const rclcpp_lifecycle::State &)
+{
+  // release everything and return to 'unconfigured' to allow a new 'configure'
+  releaseCamera();
+  stream_lost = false;
+  return CallbackReturn::SUCCESS;
+}
+
+void
+CameraNode::releaseCamera()
+{
+  replay.reset();
+  releaseBuffers();
+  config.reset();
+  // the control ids are owned by the camera, the parameters stay declared
+  parameter_ids.clear();
+  if (camera) {
+    // commands refer to controls of this camera, which 'onControls' reads under the lock
+    std::lock_guard<std::mutex> guard(control_commands_lock);
+    control_commands.clear();
+    control_commands_applied.clear();
+    camera->release();
+    camera.reset();
   }
+  if (camera_manager) {
+    camera_manager->stop();
+    camera_manager.reset();
+  }
+}
 
-  if (!camera)
-    throw std::runtime_error("failed to find camera");
+std::tuple<std::unique_ptr<libcamera::CameraConfiguration>, libcamera::CameraConfiguration::Status>
+CameraNode::generateConfiguration(const libcamera::StreamRole role, const std::string &format,
+                                  const libcamera::Size &size)
+{
+  // select the sensor mode with the lowest readout cost for the requested frame rate
+  std::optional<SensorMode> sensor_mode;
+  if (fps > 0) {
+    const auto [selected, status] = select_sensor_mode(sensor_modes, size, fps);
+    for (size_t i = 0; i < sensor_modes.size(); i++)
+      RCLCPP_INFO_STREAM(get_logger(), "sensor mode " << sensor_modes[i] << ": " << status[i]);
+    if (selected)
+      sensor_mode = sensor_modes[selected.value()];
+    else
+      RCLCPP_WARN_STREAM(get_logger(), "no sensor mode provides " << fps
+                                                                  << " fps, using default mode");
+  }
 
-  if (camera->acquire())
-    throw std::runtime_error("failed to acquire camera");
+  // configure camera stream, with an additional raw stream to select the sensor mode
+  std::vector<libcamera::StreamRole> roles = {role};
+  if (sensor_mode && role != libcamera::StreamRole::Raw)
+    roles.push_back(libcamera::StreamRole::Raw);
 
-  // configure camera stream
-  std::unique_ptr<libcamera::CameraConfiguration> cfg =
-    camera->generateConfiguration({get_role(get_parameter("role").as_string())});
+  std::unique_ptr<libcamera::CameraConfiguration> cfg = camera->generateConfiguration(roles);
 
   if (!cfg)
     throw std::runtime_error("failed to generate configuration");
 
+  if (sensor_mode && cfg->size() > 1) {
+    cfg->at(1).pixelFormat = sensor_mode->format;
+    cfg->at(1).size = sensor_mode->size;
+  }
+
   libcamera::StreamConfiguration &scfg = cfg->at(0);
   // store full list of stream formats
   const libcamera::StreamFormats &stream_formats = scfg.formats();
   const std::vector<libcamera::PixelFormat> &pixel_formats = scfg.formats().pixelformats();
-  const std::string format = get_parameter("format").as_string();
   if (format.empty()) {
     RCLCPP_INFO_STREAM(get_logger(), stream_formats);
     // check if the default pixel format is supported
@@ -265,8 +1185,12 @@ CameraNode::CameraNode(const rclcpp::NodeOptions &options) : Node("camera", opti
     scfg.pixelFormat = format_requested;
   }
 
-  const libcamera::Size size(get_parameter("width").as_int(), get_parameter("height").as_int());
-  if (size.isNull()) {
+  if (size.isNull() && sensor_mode) {
+    scfg.size = sensor_mode->size;
+    RCLCPP_INFO_STREAM(get_logger(),
+                       "no dimensions selected, using sensor mode: \"" << scfg.size << "\"");
+  }
+  else if (size.isNull()) {
     RCLCPP_INFO_STREAM(get_logger(), scfg);
     scfg.size = scfg.formats().sizes(scfg.pixelFormat).back();
     RCLCPP_WARN_STREAM(get_logger(),
@@ -279,7 +1203,8 @@ CameraNode::CameraNode(const rclcpp::NodeOptions &options) : Node("camera", opti
   // store selected stream configuration
   const libcamera::StreamConfiguration selected_scfg = scfg;
 
-  switch (cfg->validate()) {
+  const libcamera::CameraConfiguration::Status status = cfg->validate();
+  switch (status) {
   case libcamera::CameraConfiguration::Valid:
     break;
   case libcamera::CameraConfiguration::Adjusted:
@@ -296,16 +1221,26 @@ CameraNode::CameraNode(const rclcpp::NodeOptions &options) : Node("camera", opti
     break;
   }
 
-  if (camera->configure(cfg.get()) < 0)
+  if (sensor_mode && cfg->size() > 1 && cfg->at(1).size != sensor_mode->size)
+    RCLCPP_WARN_STREAM(get_logger(), "sensor mode adjusted from \"" << sensor_mode->size
+                                                                     << "\" to \""
+                                                                     << cfg->at(1).size << "\"");
+
+  return {std::move(cfg), status};
+}
+
+void
+CameraNode::applyConfiguration(libcamera::CameraConfiguration *cfg)
+{
+  if (camera->configure(cfg) < 0)
     throw std::runtime_error("failed to configure streams");
 
+  const libcamera::StreamConfiguration &scfg = cfg->at(0);
+  stream = scfg.stream();
+
   RCLCPP_INFO_STREAM(get_logger(), "camera \"" << camera->id() << "\" configured with "
                                                << scfg.toString() << " stream");
 
-  set_parameter(rclcpp::Parameter("width", int64_t(scfg.size.width)));
-  set_parameter(rclcpp::Parameter("height", int64_t(scfg.size.height)));
-  set_parameter(rclcpp::Parameter("format", scfg.pixelFormat.toString()));
-
   // format camera name for calibration file
   const libcamera::ControlList &props = camera->properties();
   std::string cname = camera->id() + '_' + scfg.size.toString();
@@ -322,14 +1257,16 @@ CameraNode::CameraNode(const rclcpp::NodeOptions &options) : Node("camera", opti
 
   if (!cim.setCameraName(cname))
     throw std::runtime_error("camera name must only contain alphanumeric characters");
+  // the calibration depends on the size in the name, reload it from the default URL
+  cim.loadCameraInfo({});
+}
 
-  declareParameters();
-
-  // allocate stream buffers and create one request per buffer
-  stream = scfg.stream();
-
+void
+CameraNode::allocateBuffers()
+{
   allocator = std::make_shared<libcamera::FrameBufferAllocator>(camera);
-  allocator->allocate(stream);
+  if (allocator->allocate(stream) < 0)
+    throw std::runtime_error("failed to allocate buffers");
 
   for (const std::unique_ptr<libcamera::FrameBuffer> &buffer : allocator->buffers(stream)) {
     std::unique_ptr<libcamera::Request> request = camera->createRequest();
@@ -351,52 +1288,154 @@ CameraNode::CameraNode(const rclcpp::NodeOptions &options) : Node("camera", opti
         throw std::runtime_error("plane file descriptors differ");
     }
 
-    // memory-map the frame buffer planes
-    void *data = mmap(nullptr, buffer_length, PROT_READ, MAP_SHARED, fd, 0);
+    // memory-map the frame buffer planes, pre-faulted to avoid page faults on the first frames
+    void *data = mmap(nullptr, buffer_length, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
     if (data == MAP_FAILED)
       throw std::runtime_error("mmap failed: " + std::string(std::strerror(errno)));
     buffer_info[buffer.get()] = {data, buffer_length};
 
+    if (copy_kernel.empty())
+      selectCopyKernel(static_cast<const uint8_t *>(data), buffer_length);
+
     if (request->addBuffer(stream, buffer.get()) < 0)
       throw std::runtime_error("Can't set buffer for request");
 
     requests.push_back(std::move(request));
   }
+}
+
+void
+CameraNode::releaseBuffers()
+{
+  requests.clear();
+  for (const auto &e : buffer_info)
+    if (munmap(e.second.data, e.second.size) == -1)
+      std::cerr << "munmap failed: " << std::strerror(errno) << std::endl;
+  buffer_info.clear();
+  allocator.reset();
+}
+
+void
+CameraNode::startStreaming()
+{
+  if (replay) {
+    replay_stop = false;
+    replay_thread = std::thread(&CameraNode::replayFrames, this);
+    return;
+  }
+
+  // restore the full set of controls, the camera resets them on configuration
+  libcamera::ControlList controls_init(camera->controls());
+  for (const auto &[name, value] : parameters_full) {
+    if (!parameter_ids.count(name))
+      continue;
+    const libcamera::ControlId *id = parameter_ids.at(name);
+    const libcamera::ControlValue cv = pv_to_cv(rclcpp::Parameter(name, value), id->type());
+    if (!cv.isNone())
+      controls_init.set(id->id(), cv);
+  }
+
+  parameters_lock.lock();
+  parameters.clear();
+  parameters_lock.unlock();
 
   // register callback
   camera->requestCompleted.connect(this, &CameraNode::requestComplete);
 
   // start camera and queue all requests
-  if (camera->start())
+  if (camera->start(&controls_init))
     throw std::runtime_error("failed to start camera");
 
   for (std::unique_ptr<libcamera::Request> &request : requests)
     camera->queueRequest(request.get());
 }
 
-CameraNode::~CameraNode()
+void
+CameraNode::stopStreaming()
 {
+  if (replay) {
+    replay_stop = true;
+    if (replay_thread.joinable())
+      replay_thread.join();
+    return;
+  }
+
   camera->requestCompleted.disconnect();
   request_lock.lock();
   if (camera->stop())
     std::cerr << "failed to stop camera" << std::endl;
   request_lock.unlock();
-  camera->release();
-  camera_manager.stop();
-  for (const auto &e : buffer_info)
-    if (munmap(e.second.data, e.second.size) == -1)
-      std::cerr << "munmap failed: " << std::strerror(errno) << std::endl;
+}
+
+std::vector<SensorMode>
+CameraNode::probeSensorModes(const libcamera::StreamRole role)
+{
+  std::vector<SensorMode> modes;
+
+  // the raw stream formats and sizes correspond to the sensor modes
+  const std::unique_ptr<libcamera::CameraConfiguration> cfg_raw =
+    camera->generateConfiguration({libcamera::StreamRole::Raw});
+  if (!cfg_raw)
+    return modes;
+
+  const libcamera::StreamFormats &raw_formats = cfg_raw->at(0).formats();
+  for (const libcamera::PixelFormat &format : raw_formats.pixelformats()) {
+    for (const libcamera::Size &size : raw_formats.sizes(format)) {
+      // configure the sensor mode to query its frame duration limits
+      std::vector<libcamera::StreamRole> roles = {libcamera::StreamRole::Raw};
+      if (role != libcamera::StreamRole::Raw)
+        roles.insert(roles.begin(), role);
+      std::unique_ptr<libcamera::CameraConfiguration> cfg = camera->generateConfiguration(roles);
+      if (!cfg)
+        continue;
+
+      libcamera::StreamConfiguration &scfg_raw = cfg->at(cfg->size() - 1);
+      scfg_raw.pixelFormat = format;
+      scfg_raw.size = size;
+
+      if (cfg->validate() == libcamera::CameraConfiguration::Invalid ||
+          scfg_raw.pixelFormat != format || scfg_raw.size != size || camera->configure(cfg.get()))
+      {
+        RCLCPP_DEBUG_STREAM(get_logger(), "sensor mode " << format << " " << size.toString()
+                                                         << " cannot be configured");
+        continue;
+      }
+
+      double fps_max = 0;
+      const auto it = camera->controls().find(&libcamera::controls::FrameDurationLimits);
+      if (it != camera->controls().end() && !it->second.min().isNone()) {
+        const int64_t frame_duration_min = min<libcamera::ControlTypeInteger64>(it->second.min());
+        if (frame_duration_min > 0)
+          fps_max = 1e6 / frame_duration_min;
+      }
+
+      modes.push_back({format, size, fps_max});
+    }
+  }
+
+  return modes;
+}
+
+void
+CameraNode::registerParameterCallback()
+{
+  if (!callback_parameter_change)
+    callback_parameter_change = add_on_set_parameters_callback(
+      std::bind(&CameraNode::onParameterChange, this, std::placeholders::_1));
 }
 
 void
-CameraNode::declareParameters()
+CameraNode::declareControls()
 {
+  // the callback may already be registered by a replay, remove it during declaration
+  if (callback_parameter_change) {
+    remove_on_set_parameters_callback(callback_parameter_change.get());
+    callback_parameter_change.reset();
+  }
+
   // dynamic camera configuration
   ParameterMap parameters_init;
   for (const auto &[id, info] : camera->controls()) {
-    // store control id with name
-    parameter_ids[id->name()] = id;
-
     std::size_t extent;
     try {
       extent = get_extent(id);
@@ -450,6 +1489,7 @@ CameraNode::declareParameters()
       param_descr.floating_point_range = {range_float};
 
     // declare parameters and set default or initial value
+    control_parameters.insert(id->name());
     RCLCPP_DEBUG_STREAM(get_logger(),
                         "declare " << id->name() << " with default " << rclcpp::to_string(value));
     if (value.get_type() == rclcpp::ParameterType::PARAMETER_NOT_SET) {
@@ -461,16 +1501,25 @@ CameraNode::declareParameters()
     }
   }
 
+  controls_declared = true;
+
   // register callback to handle parameter changes
   // We have to register the callback after parameter declaration
   // to avoid callbacks interfering with the default parameter check.
-  callback_parameter_change = add_on_set_parameters_callback(
-    std::bind(&CameraNode::onParameterChange, this, std::placeholders::_1));
+  registerParameterCallback();
+
+  // limit the frame duration to the requested frame rate, unless set by the user
+  ParameterMap parameters_overrides = get_node_parameters_interface()->get_parameter_overrides();
+  if (fps > 0 && parameter_ids.count("FrameDurationLimits") &&
+      !parameters_overrides.count("FrameDurationLimits"))
+  {
+    const int64_t frame_duration = 1e6 / fps;
+    parameters_overrides["FrameDurationLimits"] =
+      rclcpp::ParameterValue(std::vector<int64_t> {frame_duration, frame_duration});
+  }
 
   // resolve conflicts of default libcamera configuration and user provided overrides
-  std::vector<std::string> status;
-  std::tie(parameters_init, status) =
-    resolve_conflicts(parameters_init, get_node_parameters_interface()->get_parameter_overrides());
+  const std::vector<std::string> status = resolve_conflicts(parameters_init, parameters_overrides);
 
   for (const std::string &s : status)
     RCLCPP_WARN_STREAM(get_logger(), s);
@@ -484,6 +1533,12 @@ CameraNode::declareParameters()
 void
 CameraNode::requestComplete(libcamera::Request *request)
 {
+  // schedule the thread of the camera manager that calls this, once per thread
+  if (capture_thread != std::this_thread::get_id()) {
+    capture_thread = std::this_thread::get_id();
+    applyScheduling(scheduling_capture, "capture");
+  }
+
   request_lock.lock();
 
   if (request->status() == libcamera::Request::RequestComplete) {
@@ -496,58 +1551,45 @@ CameraNode::requestComplete(libcamera::Request *request)
     for (const libcamera::FrameMetadata::Plane &plane : metadata.planes())
       bytesused += plane.bytesused;
 
+    // the frame timestamp is taken from the monotonic clock at the start of the frame
+    frame_age.add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch())
+                    .count() -
+                  int64_t(metadata.timestamp));
+
     // set time offset once for accurate timing using the device time
     if (time_offset == 0)
       time_offset = this->now().nanoseconds() - metadata.timestamp;
 
-    // send image data
-    std_msgs::msg::Header hdr;
-    hdr.stamp = rclcpp::Time(time_offset + int64_t(metadata.timestamp));
-    hdr.frame_id = "camera";
+    // frame in the mapped buffer with the system timestamp
     const libcamera::StreamConfiguration &cfg = stream->configuration();
-
-    auto msg_img = std::make_unique<sensor_msgs::msg::Image>();
-    auto msg_img_compressed = std::make_unique<sensor_msgs::msg::CompressedImage>();
-
-    if (format_type(cfg.pixelFormat) == FormatType::RAW) {
-      // raw uncompressed image
-      assert(buffer_info[buffer].size == bytesused);
-      msg_img->header = hdr;
-      msg_img->width = cfg.size.width;
-      msg_img->height = cfg.size.height;
-      msg_img->step = cfg.stride;
-      msg_img->encoding = get_ros_encoding(cfg.pixelFormat);
-      msg_img->is_bigendian = (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__);
-      msg_img->data.resize(buffer_info[buffer].size);
-      memcpy(msg_img->data.data(), buffer_info[buffer].data, buffer_info[buffer].size);
-
-      // compress to jpeg
-      if (pub_image_compressed->get_subscription_count())
-        cv_bridge::toCvCopy(*msg_img)->toCompressedImageMsg(*msg_img_compressed);
-    }
-    else if (format_type(cfg.pixelFormat) == FormatType::COMPRESSED) {
-      // compressed image
-      assert(bytesused < buffer_info[buffer].size);
-      msg_img_compressed->header = hdr;
-      msg_img_compressed->format = get_ros_encoding(cfg.pixelFormat);
-      msg_img_compressed->data.resize(bytesused);
-      memcpy(msg_img_compressed->data.data(), buffer_info[buffer].data, bytesused);
-
-      // decompress into raw rgb8 image
-      if (pub_image->get_subscription_count())
-        cv_bridge::toCvCopy(*msg_img_compressed, "rgb8")->toImageMsg(*msg_img);
-    }
-    else {
-      throw std::runtime_error("unsupported pixel format: " +
-                               stream->configuration().pixelFormat.toString());
+    FrameIndexEntry frame = {};
+    frame.sequence = metadata.sequence;
+    frame.timestamp = time_offset + int64_t(metadata.timestamp);
+    frame.width = cfg.size.width;
+    frame.height = cfg.size.height;
+    frame.step = cfg.stride;
+    frame.size = bytesused;
+    set_frame_format(frame, get_ros_encoding(cfg.pixelFormat));
+    const FormatType type = format_type(cfg.pixelFormat);
+    if (type == FormatType::NONE)
+      throw std::runtime_error("unsupported pixel format: " + cfg.pixelFormat.toString());
+    assert(type != FormatType::RAW || buffer_info[buffer].size == bytesused);
+
+    processFrame(frame, static_cast<const uint8_t *>(buffer_info[buffer].data), type);
+
+    if (pub_metadata->get_subscription_count())
+      publishMetadata(request->metadata(), frame);
+
+    if (request->metadata().contains(libcamera::controls::ScalerCrop.id())) {
+      std::lock_guard<std::mutex> guard(regions_lock);
+      scaler_crop = request->metadata()
+                      .get(libcamera::controls::ScalerCrop.id())
+                      .get<libcamera::Rectangle>();
     }
 
-    pub_image->publish(std::move(msg_img));
-    pub_image_compressed->publish(std::move(msg_img_compressed));
-
-    sensor_msgs::msg::CameraInfo ci = cim.getCameraInfo();
-    ci.header = hdr;
-    pub_ci->publish(ci);
+    sequence_last = metadata.sequence;
+    measureControlLatency(request->metadata());
   }
   else if (request->status() == libcamera::Request::RequestCancelled) {
     RCLCPP_ERROR_STREAM(get_logger(), "request '" << request->toString() << "' cancelled");
@@ -563,22 +1605,461 @@ CameraNode::requestComplete(libcamera::Request *request)
   parameters.clear();
   parameters_lock.unlock();
 
+  // topic controls up to the frame that this request is expected to capture
+  control_commands_lock.lock();
+  const uint64_t sequence_next = sequence_last + requests.size();
+  for (auto it = control_commands.begin(); it != control_commands.end();) {
+    if (it->sequence <= sequence_next) {
+      request->controls().set(it->id, it->value);
+      control_commands_applied.push_back(std::move(*it));
+      it = control_commands.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+  control_commands_lock.unlock();
+
   camera->queueRequest(request);
 
   request_lock.unlock();
 }
 
-rcl_interfaces::msg::SetParametersResult
-CameraNode::onParameterChange(const std::vector<rclcpp::Parameter> &parameters)
+void
+CameraNode::processFrame(const FrameIndexEntry &frame, const uint8_t *data,
+                         const FormatType type)
 {
-  rcl_interfaces::msg::SetParametersResult result;
-
-  // check target parameter state (current and new parameters)
-  // for conflicting configuration
-  const std::vector<std::string> msgs = check_conflicts(parameters, parameters_full);
-  if (!msgs.empty()) {
-    result.successful = false;
-    for (size_t i = 0; i < msgs.size(); i++) {
+  const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+  // counters of the calling capture or replay thread
+  thread_local const MemoryCounters memory_counters;
+  const MemoryCounts memory_begin = memory_counters.read();
+
+  // send image data
+  std_msgs::msg::Header hdr;
+  hdr.stamp = rclcpp::Time(frame.timestamp);
+  hdr.frame_id = "camera";
+  const std::string encoding = get_frame_format(frame);
+
+  // keep every frame in the pre-trigger ring and recording, before decimation and rate limits
+  std::unique_lock<std::mutex> recorder_guard(recorder_lock);
+  if (pretrigger || recorder) {
+    // record uncompressed frames straight from the mapped buffer
+    if (recorder)
+      recorder->push(frame, data);
+
+    if (pretrigger) {
+      FrameIndexEntry entry = frame;
+      const uint8_t *payload = data;
+      if (pretrigger_compress && type == FormatType::RAW) {
+        compress_raw({data, frame.width, frame.height, frame.step, encoding}, true, *workers,
+                     pretrigger_buffer);
+        set_frame_format(entry, raw_compression_format(encoding, true));
+        entry.size = pretrigger_buffer.size();
+        payload = pretrigger_buffer.data();
+      }
+      if (!pretrigger->push(entry, payload))
+        RCLCPP_WARN_STREAM_ONCE(get_logger(), "frame of " << entry.size
+                                                          << " bytes exceeds the ring");
+    }
+  }
+  recorder_guard.unlock();
+
+  // statistics of every frame, before decimation and rate limits
+  if (pub_statistics->get_subscription_count())
+    publishStatistics(hdr, frame, data, type);
+
+  // suppress frames without scene change, apart from a heartbeat
+  const bool changed = detectChange(frame, data, type);
+
+  // skip decimated and rate limited frames before copying or encoding,
+  // the full frame is only copied for subscribers or the encoder
+  const bool process_raw =
+    changed && rate_raw.check(frame.timestamp) && !load_shedding.drop_raw();
+  const bool publish_raw = process_raw && pub_image->get_subscription_count();
+  bool publish_compressed = changed && pub_image_compressed->get_subscription_count() &&
+                            rate_compressed.check(frame.timestamp);
+  // skip the copy for the encoder workers if they would reject the frame
+  const bool encode_async = publish_compressed && type == FormatType::RAW && !compress_lz4 &&
+                            jpeg_workers && !load_shedding.skip_encode();
+  if (encode_async && !jpeg_workers->admit())
+    publish_compressed = false;
+
+  auto msg_img = std::make_unique<sensor_msgs::msg::Image>();
+  // raw image shared with the encoder workers
+  std::shared_ptr<sensor_msgs::msg::Image> image_shared;
+  auto msg_img_compressed = std::make_unique<sensor_msgs::msg::CompressedImage>();
+  // compressed image is published by the encoder workers
+  bool compressed_async = false;
+
+  if (!publish_raw && !publish_compressed) {
+    // no image is published, skip copying
+  }
+  else if (type == FormatType::RAW) {
+    // raw uncompressed image
+    msg_img->header = hdr;
+    msg_img->width = frame.width;
+    msg_img->height = frame.height;
+    msg_img->step = frame.step;
+    msg_img->encoding = encoding;
+    msg_img->is_bigendian = (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__);
+    msg_img->data.resize(frame.size);
+    copy_frame(msg_img->data.data(), data, frame.size);
+
+    // compress to jpeg or lossless lz4
+    if (publish_compressed && !load_shedding.skip_encode()) {
+      if (compress_lz4) {
+        msg_img_compressed->header = hdr;
+        msg_img_compressed->format = raw_compression_format(msg_img->encoding, compress_delta);
+        compress_raw({msg_img->data.data(), msg_img->width, msg_img->height, msg_img->step,
+                      msg_img->encoding},
+                     compress_delta, *workers, msg_img_compressed->data);
+      }
+      else if (jpeg_workers) {
+        // encode on the workers and publish in sequence order, sharing the raw image with
+        // its publisher instead of copying it
+        image_shared = std::move(msg_img);
+        const std::shared_ptr<const sensor_msgs::msg::Image> image = image_shared;
+        const auto msg = std::make_shared<sensor_msgs::msg::CompressedImage>();
+        jpeg_workers->submit(
+          [this, image, msg]() {
+            try {
+              encodeJpeg(*image, *msg);
+            }
+            catch (const std::exception &e) {
+              RCLCPP_ERROR_STREAM(get_logger(), "JPEG encoding failed: " << e.what());
+            }
+          },
+          [this, msg]() {
+            if (!msg->data.empty())
+              pub_image_compressed->publish(
+                std::make_unique<sensor_msgs::msg::CompressedImage>(std::move(*msg)));
+          });
+        compressed_async = true;
+      }
+      else {
+        encodeJpeg(*msg_img, *msg_img_compressed);
+      }
+    }
+  }
+  else if (type == FormatType::COMPRESSED) {
+    // compressed image
+    msg_img_compressed->header = hdr;
+    msg_img_compressed->format = encoding;
+    msg_img_compressed->data.resize(frame.size);
+    copy_frame(msg_img_compressed->data.data(), data, frame.size);
+
+    // decompress into raw rgb8 image
+    if (publish_raw && !load_shedding.skip_decode() && pub_image->get_subscription_count())
+      cv_bridge::toCvCopy(*msg_img_compressed, "rgb8")->toImageMsg(*msg_img);
+  }
+  else {
+    throw std::runtime_error("unsupported format: " + encoding);
+  }
+
+  sensor_msgs::msg::CameraInfo ci;
+  if (process_raw || publish_compressed) {
+    ci = cim.getCameraInfo();
+    ci.header = hdr;
+  }
+
+  // rectify from the mapped buffer, the tables are only recomputed for a new calibration
+  if (process_raw && rectify && type == FormatType::RAW &&
+      pub_image_rect->get_subscription_count())
+  {
+    if (!rectification_supported(encoding)) {
+      RCLCPP_WARN_STREAM_ONCE(get_logger(), "rectification of " << encoding << " not supported");
+    }
+    else if (!rectification.update(ci) || rectification.width() != frame.width ||
+             rectification.height() != frame.height)
+    {
+      RCLCPP_WARN_STREAM_ONCE(get_logger(), "no calibration of size " << frame.width << "x"
+                                                                       << frame.height
+                                                                       << " for rectification");
+    }
+    else {
+      auto msg_img_rect = std::make_unique<sensor_msgs::msg::Image>();
+      msg_img_rect->header = hdr;
+      msg_img_rect->width = frame.width;
+      msg_img_rect->height = frame.height;
+      msg_img_rect->step = frame.step;
+      msg_img_rect->encoding = encoding;
+      msg_img_rect->is_bigendian = (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__);
+      msg_img_rect->data.resize(std::size_t(frame.step) * frame.height);
+      rectification.remap({data, frame.width, frame.height, frame.step, encoding},
+                          msg_img_rect->data.data(), *workers);
+      pub_image_rect->publish(std::move(msg_img_rect));
+    }
+  }
+
+  // reduced resolutions from the mapped buffer, in one pass for both levels
+  const bool publish_half = process_raw && pub_image_half->get_subscription_count();
+  const bool publish_quarter = process_raw && pub_image_quarter->get_subscription_count();
+  if (type == FormatType::RAW && (publish_half || publish_quarter)) {
+    if (pyramid_encoding(encoding).empty()) {
+      RCLCPP_WARN_STREAM_ONCE(get_logger(), "downscaling of " << encoding << " not supported");
+    }
+    else {
+      auto msg_img_half = std::make_unique<sensor_msgs::msg::Image>();
+      auto msg_img_quarter = std::make_unique<sensor_msgs::msg::Image>();
+      downscale_pyramid({data, frame.width, frame.height, frame.step, encoding},
+                        publish_half ? msg_img_half.get() : nullptr,
+                        publish_quarter ? msg_img_quarter.get() : nullptr, *workers);
+      if (publish_half) {
+        msg_img_half->header = hdr;
+        pub_image_half->publish(std::move(msg_img_half));
+      }
+      if (publish_quarter) {
+        msg_img_quarter->header = hdr;
+        pub_image_quarter->publish(std::move(msg_img_quarter));
+      }
+    }
+  }
+
+  // regions of interest straight from the mapped buffer
+  if (process_raw && type == FormatType::RAW) {
+    std::lock_guard<std::mutex> guard(regions_lock);
+    for (std::size_t i = 0; i < regions.size(); i++) {
+      if (!pub_regions[i]->get_subscription_count())
+        continue;
+      auto msg_img_region = std::make_unique<sensor_msgs::msg::Image>();
+      if (!crop_image({data, frame.width, frame.height, frame.step, encoding}, regions[i],
+                      *msg_img_region))
+        continue;
+      msg_img_region->header = hdr;
+      pub_regions[i]->publish(std::move(msg_img_region));
+    }
+  }
+
+  // images are empty if encoding or decoding was skipped
+  if (publish_raw && image_shared)
+    pub_image->publish(*image_shared);
+  else if (publish_raw && !msg_img->data.empty())
+    pub_image->publish(std::move(msg_img));
+  if (publish_compressed && !compressed_async && !msg_img_compressed->data.empty())
+    pub_image_compressed->publish(std::move(msg_img_compressed));
+
+  if (process_raw || publish_compressed)
+    pub_ci->publish(ci);
+
+  // compare the processing time with the sensor frame period
+  if (timestamp_prev)
+    load_shedding.update(
+      std::chrono::nanoseconds(std::chrono::steady_clock::now() - t0).count(),
+      frame.timestamp - timestamp_prev);
+  timestamp_prev = frame.timestamp;
+
+  // moving average of the page faults and TLB misses of this frame in the calling thread
+  const MemoryCounts memory_end = memory_counters.read();
+  const double faults = (memory_end.minor_faults - memory_begin.minor_faults) +
+                        (memory_end.major_faults - memory_begin.major_faults);
+  page_faults = 0.9 * page_faults + 0.1 * faults;
+  if (memory_end.tlb_misses >= 0 && memory_begin.tlb_misses >= 0)
+    tlb_misses = 0.9 * tlb_misses + 0.1 * (memory_end.tlb_misses - memory_begin.tlb_misses);
+  else
+    tlb_misses = -1;
+
+  if (load_shedding.level() != load_shedding_level) {
+    load_shedding_level = load_shedding.level();
+    RCLCPP_WARN_STREAM(get_logger(), "load shedding: "
+                                       << LoadShedding::describe(load_shedding_level) << " (load "
+                                       << load_shedding.load() << ")");
+  }
+}
+
+void
+CameraNode::replayFrames()
+{
+  applyScheduling(scheduling_capture, "capture");
+
+  const double rate = get_parameter("replay.rate").as_double();
+  const bool loop = get_parameter("replay.loop").as_bool();
+  RCLCPP_INFO_STREAM(get_logger(), "replaying " << replay->frames() << " frames at rate " << rate);
+
+  // payload of frames that were stored with lossless compression
+  std::vector<uint8_t> pixels;
+  uint64_t sequence = 0;
+
+  do {
+    const std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+    const int64_t timestamp_start = this->now().nanoseconds();
+    const int64_t timestamp_first = replay->entry(0).timestamp;
+
+    for (std::size_t i = 0; i < replay->frames() && !replay_stop; i++) {
+      FrameIndexEntry frame = replay->entry(i);
+      const uint8_t *data = replay->data(i);
+
+      // keep the recorded frame intervals, scaled by the replay rate
+      if (rate > 0) {
+        const int64_t elapsed = int64_t((frame.timestamp - timestamp_first) / rate);
+        std::this_thread::sleep_until(t_start + std::chrono::nanoseconds(elapsed));
+        frame.timestamp = timestamp_start + elapsed;
+      }
+      else {
+        frame.timestamp = this->now().nanoseconds();
+      }
+      frame.sequence = sequence++;
+
+      std::string format = get_frame_format(frame);
+      const FormatType type = format == "jpeg" ? FormatType::COMPRESSED : FormatType::RAW;
+
+      try {
+        const std::size_t separator = format.find("; lz4");
+        if (separator != std::string::npos) {
+          format.resize(separator);
+          const RawCompressionHeader header =
+            decompress_raw(data, frame.size, format, *workers, pixels);
+          if (header.width != frame.width || header.height != frame.height ||
+              header.step != frame.step)
+            throw std::runtime_error("compressed frame does not match its index entry");
+          set_frame_format(frame, format);
+          frame.size = pixels.size();
+          data = pixels.data();
+        }
+
+        processFrame(frame, data, type);
+      }
+      catch (const std::exception &e) {
+        RCLCPP_ERROR_STREAM(get_logger(), "failed to replay frame " << i << ": " << e.what());
+      }
+    }
+  } while (loop && !replay_stop);
+
+  RCLCPP_INFO_STREAM(get_logger(), "replay finished after " << sequence << " frames");
+}
+
+rcl_interfaces::msg::SetParametersResult
+CameraNode::reconfigureStream(const std::vector<rclcpp::Parameter> &parameters)
+{
+  rcl_interfaces::msg::SetParametersResult result;
+  result.successful = true;
+
+  // current stream configuration with requested changes
+  std::string role = get_parameter("role").as_string();
+  std::string format = get_parameter("format").as_string();
+  int64_t width = get_parameter("width").as_int();
+  int64_t height = get_parameter("height").as_int();
+  bool changed = false;
+  // number of changed dimensions in this request
+  int dimensions = 0;
+  for (const rclcpp::Parameter &parameter : parameters) {
+    if (parameter.get_name() == "role") {
+      changed |= parameter.as_string() != role;
+      role = parameter.as_string();
+    }
+    else if (parameter.get_name() == "format") {
+      changed |= parameter.as_string() != format;
+      format = parameter.as_string();
+    }
+    else if (parameter.get_name() == "width") {
+      changed |= parameter.as_int() != width;
+      width = parameter.as_int();
+      dimensions++;
+    }
+    else if (parameter.get_name() == "height") {
+      changed |= parameter.as_int() != height;
+      height = parameter.as_int();
+      dimensions++;
+    }
+  }
+
+  // the stream is configured from the parameters on the 'configure' transition
+  const uint8_t state = get_current_state().id();
+  if (!changed || (state != lifecycle_msgs::msg::State::PRIMARY_STATE_INACTIVE &&
+                   state != lifecycle_msgs::msg::State::PRIMARY_STATE_ACTIVE))
+    return result;
+
+  // replayed frames keep the stream configuration of the file
+  if (!camera) {
+    result.successful = false;
+    result.reason = "stream configuration requires a configured camera";
+    return result;
+  }
+
+  const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+  // validate the new configuration while the camera is still streaming
+  std::unique_ptr<libcamera::CameraConfiguration> cfg;
+  libcamera::CameraConfiguration::Status status;
+  try {
+    std::tie(cfg, status) =
+      generateConfiguration(get_role(role), format, libcamera::Size(width, height));
+  }
+  catch (const std::runtime_error &e) {
+    result.successful = false;
+    result.reason = e.what();
+    return result;
+  }
+
+  // parameters must reflect the actual configuration, reject adjusted configurations
+  if (status == libcamera::CameraConfiguration::Adjusted) {
+    result.successful = false;
+    result.reason = "stream configuration adjusted to \"" + cfg->at(0).toString() +
+                    "\", request this configuration instead";
+    if (dimensions == 1)
+      result.reason += ", with 'width' and 'height' set together";
+    return result;
+  }
+
+  // stop, unmap, reconfigure, reallocate and restart, keeping publishers and parameters
+  try {
+    if (state == lifecycle_msgs::msg::State::PRIMARY_STATE_ACTIVE)
+      stopStreaming();
+    releaseBuffers();
+    applyConfiguration(cfg.get());
+    allocateBuffers();
+    if (state == lifecycle_msgs::msg::State::PRIMARY_STATE_ACTIVE)
+      startStreaming();
+  }
+  catch (const std::runtime_error &e) {
+    RCLCPP_ERROR_STREAM(get_logger(), "stream reconfiguration failed: " << e.what());
+    result.successful = false;
+    result.reason = e.what();
+
+    // restore the previous configuration, which the parameters still describe
+    try {
+      camera->requestCompleted.disconnect();
+      releaseBuffers();
+      applyConfiguration(config.get());
+      allocateBuffers();
+      if (state == lifecycle_msgs::msg::State::PRIMARY_STATE_ACTIVE)
+        startStreaming();
+    }
+    catch (const std::runtime_error &e_restore) {
+      RCLCPP_ERROR_STREAM(get_logger(), "failed to restore stream configuration: "
+                                          << e_restore.what());
+      result.reason += ", failed to restore stream configuration: " + std::string(e_restore.what());
+      // leave the configured states through the error transition
+      stream_lost = true;
+      if (state == lifecycle_msgs::msg::State::PRIMARY_STATE_ACTIVE)
+        deactivate();
+      else
+        cleanup();
+    }
+    return result;
+  }
+
+  config = std::move(cfg);
+
+  const double latency =
+    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+  RCLCPP_INFO_STREAM(get_logger(), "stream reconfigured to \"" << config->at(0).toString()
+                                                               << "\" in " << latency << " ms");
+
+  return result;
+}
+
+rcl_interfaces::msg::SetParametersResult
+CameraNode::onParameterChange(const std::vector<rclcpp::Parameter> &parameters)
+{
+  rcl_interfaces::msg::SetParametersResult result;
+
+  // check target parameter state (current and new parameters)
+  // for conflicting configuration
+  const std::vector<std::string> msgs = check_conflicts(parameters, parameters_full);
+  if (!msgs.empty()) {
+    result.successful = false;
+    for (size_t i = 0; i < msgs.size(); i++) {
       if (msgs.size() > 1)
         result.reason += "(" + std::to_string(i) + ") ";
       result.reason += msgs[i];
@@ -588,55 +2069,799 @@ CameraNode::onParameterChange(const std::vector<rclcpp::Parameter> &parameters)
     return result;
   }
 
-  result.successful = true;
+  for (const rclcpp::Parameter &parameter : parameters) {
+    if (!camera && control_parameters.count(parameter.get_name())) {
+      result.successful = false;
+      result.reason = parameter.get_name() + ": control requires a configured camera";
+      return result;
+    }
+    if (parameter.get_name() == "compressed.codec" && parameter.as_string() != "jpeg" &&
+        parameter.as_string() != "lz4")
+    {
+      result.successful = false;
+      result.reason = "invalid codec: \"" + parameter.as_string() + "\"";
+      return result;
+    }
+  }
 
+  // validate all control values before anything is changed
+  std::vector<std::tuple<const rclcpp::Parameter *, const libcamera::ControlId *,
+                         libcamera::ControlValue>>
+    controls;
   for (const rclcpp::Parameter &parameter : parameters) {
-    RCLCPP_DEBUG_STREAM(get_logger(), "setting " << parameter.get_type_name() << " parameter "
-                                                 << parameter.get_name() << " to "
-                                                 << parameter.value_to_string());
-
-    if (parameter_ids.count(parameter.get_name())) {
-      const libcamera::ControlId *id = parameter_ids.at(parameter.get_name());
-      libcamera::ControlValue value = pv_to_cv(parameter, id->type());
-
-      if (!value.isNone()) {
-        // verify parameter type and dimension against default
-        const libcamera::ControlInfo &ci = camera->controls().at(id);
-
-        if (value.type() != id->type()) {
-          result.successful = false;
-          result.reason = parameter.get_name() + ": parameter types mismatch, expected '" +
-                          std::to_string(id->type()) + "', got '" + std::to_string(value.type()) +
-                          "'";
-          return result;
-        }
+    if (!parameter_ids.count(parameter.get_name()))
+      continue;
 
-        const std::size_t extent = get_extent(id);
-        if ((value.isArray() && (extent > 0)) && value.numElements() != extent) {
-          result.successful = false;
-          result.reason = parameter.get_name() + ": parameter dimensions mismatch, expected " +
-                          std::to_string(extent) + ", got " + std::to_string(value.numElements());
-          return result;
-        }
+    const libcamera::ControlId *id = parameter_ids.at(parameter.get_name());
+    libcamera::ControlValue value = pv_to_cv(parameter, id->type());
+    if (value.isNone())
+      continue;
 
-        // check bounds and return error
-        if (value < ci.min() || value > ci.max()) {
-          result.successful = false;
-          result.reason =
-            "parameter value " + value.toString() + " outside of range: " + ci.toString();
-          return result;
-        }
+    // verify parameter type and dimension against default
+    const libcamera::ControlInfo &ci = camera->controls().at(id);
 
-        parameters_lock.lock();
-        this->parameters[parameter_ids.at(parameter.get_name())->id()] = value;
-        parameters_lock.unlock();
+    if (value.type() != id->type()) {
+      result.successful = false;
+      result.reason = parameter.get_name() + ": parameter types mismatch, expected '" +
+                      std::to_string(id->type()) + "', got '" + std::to_string(value.type()) +
+                      "'";
+      return result;
+    }
 
-        parameters_full[parameter.get_name()] = parameter.get_parameter_value();
-      }
+    const std::size_t extent = get_extent(id);
+    if ((value.isArray() && (extent > 0)) && value.numElements() != extent) {
+      result.successful = false;
+      result.reason = parameter.get_name() + ": parameter dimensions mismatch, expected " +
+                      std::to_string(extent) + ", got " + std::to_string(value.numElements());
+      return result;
+    }
+
+    // check bounds and return error
+    if (value < ci.min() || value > ci.max()) {
+      result.successful = false;
+      result.reason =
+        "parameter value " + value.toString() + " outside of range: " + ci.toString();
+      return result;
     }
+
+    controls.emplace_back(&parameter, id, std::move(value));
+  }
+
+  // reconfigure the stream in place if its configuration changes
+  result = reconfigureStream(parameters);
+  if (!result.successful)
+    return result;
+
+  for (const rclcpp::Parameter &parameter : parameters) {
+    if (parameter.get_name() == "load_shedding.enable")
+      load_shedding.set_enabled(parameter.as_bool());
+    else if (parameter.get_name() == "load_shedding.budget")
+      load_shedding.set_budget(parameter.as_double());
+    else if (parameter.get_name() == "compressed.codec")
+      compress_lz4 = parameter.as_string() == "lz4";
+    else if (parameter.get_name() == "pretrigger.compress")
+      pretrigger_compress = parameter.as_bool();
+    else if (parameter.get_name() == "compressed.delta")
+      compress_delta = parameter.as_bool();
+    else if (parameter.get_name() == "rectify")
+      rectify = parameter.as_bool();
+    else if (parameter.get_name() == "statistics.grid")
+      statistics_grid = parameter.as_int();
+    else if (parameter.get_name() == "change.threshold")
+      change_threshold = parameter.as_double();
+    else if (parameter.get_name() == "change.block_threshold")
+      change_block_threshold = parameter.as_double();
+    else if (parameter.get_name() == "change.heartbeat")
+      change_heartbeat = parameter.as_double();
+    else if (parameter.get_name() == "jpeg.quality")
+      jpeg_quality = parameter.as_int();
+    else if (parameter.get_name() == "jpeg.strips")
+      jpeg_strips = parameter.as_int();
+    else if (parameter.get_name() == "jpeg.target_bitrate")
+      jpeg_rate.set_target_bitrate(parameter.as_double());
+    else if (parameter.get_name() == "jpeg.target_size")
+      jpeg_rate.set_target_size(parameter.as_int());
+    else if (parameter.get_name() == "jpeg.quality_min")
+      jpeg_rate.set_bounds(parameter.as_int(), get_parameter("jpeg.quality_max").as_int());
+    else if (parameter.get_name() == "jpeg.quality_max")
+      jpeg_rate.set_bounds(get_parameter("jpeg.quality_min").as_int(), parameter.as_int());
+    else if (parameter.get_name() == "raw.decimation")
+      rate_raw.set_decimation(parameter.as_int());
+    else if (parameter.get_name() == "raw.max_rate")
+      rate_raw.set_max_rate(parameter.as_double());
+    else if (parameter.get_name() == "compressed.decimation")
+      rate_compressed.set_decimation(parameter.as_int());
+    else if (parameter.get_name() == "compressed.max_rate")
+      rate_compressed.set_max_rate(parameter.as_double());
+  }
+
+  // apply the validated control values
+  for (const auto &[parameter, id, value] : controls) {
+    RCLCPP_DEBUG_STREAM(get_logger(), "setting " << parameter->get_type_name() << " parameter "
+                                                 << parameter->get_name() << " to "
+                                                 << parameter->value_to_string());
+
+    parameters_lock.lock();
+    this->parameters[id->id()] = value;
+    parameters_lock.unlock();
+
+    parameters_full[parameter->get_name()] = parameter->get_parameter_value();
   }
 
   return result;
 }
 
+void
+CameraNode::encodeJpeg(const sensor_msgs::msg::Image &image,
+                       sensor_msgs::msg::CompressedImage &msg)
+{
+  const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+  // the quality control requires the strip encoder
+  const bool rate_control = jpeg_rate.enabled();
+  const int strips = rate_control ? std::max<int>(jpeg_strips, 1) : jpeg_strips;
+  if (strips > 0) {
+    // convert to 8-bit mono or rgb, without copying if the image already has this encoding
+    const std::string encoding = (sensor_msgs::image_encodings::numChannels(image.encoding) == 1 &&
+                                  !sensor_msgs::image_encodings::isBayer(image.encoding))
+                                   ? sensor_msgs::image_encodings::MONO8
+                                   : sensor_msgs::image_encodings::RGB8;
+    const cv_bridge::CvImageConstPtr cv_image = cv_bridge::toCvShare(image, nullptr, encoding);
+
+    msg.header = image.header;
+    msg.format = "jpeg";
+    encode_jpeg({cv_image->image.data, uint32_t(cv_image->image.cols),
+                 uint32_t(cv_image->image.rows), uint32_t(cv_image->image.step), encoding},
+                rate_control ? jpeg_rate.quality() : int(jpeg_quality), strips, *workers,
+                msg.data);
+  }
+  else {
+    cv_bridge::toCvCopy(image)->toCompressedImageMsg(msg);
+  }
+
+  jpeg_rate.update(msg.data.size(), rclcpp::Time(image.header.stamp).nanoseconds());
+
+  // moving average of the encoding latency
+  const double latency =
+    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+  jpeg_latency = jpeg_latency > 0 ? 0.9 * jpeg_latency + 0.1 * latency : latency;
+}
+
+void
+CameraNode::diagnoseLoad(diagnostic_updater::DiagnosticStatusWrapper &status)
+{
+  const uint8_t level = load_shedding.level();
+  if (level == LoadShedding::NONE)
+    status.summary(diagnostic_msgs::msg::DiagnosticStatus::OK, "no load shedding");
+  else
+    status.summary(diagnostic_msgs::msg::DiagnosticStatus::WARN, LoadShedding::describe(level));
+
+  status.add("level", int(level));
+  status.add("load", load_shedding.load());
+  status.add("JPEG encode latency (ms)", jpeg_latency.load());
+  status.add("JPEG bitrate (bytes/s)", jpeg_rate.bitrate());
+  if (jpeg_rate.enabled())
+    status.add("JPEG quality", jpeg_rate.quality());
+  if (jpeg_workers) {
+    status.add("JPEG encoder dropped", jpeg_workers->dropped());
+    status.add("JPEG encoder failed", jpeg_workers->failed());
+  }
+}
+
+void
+CameraNode::onDumpPretrigger(const std::shared_ptr<std_srvs::srv::Trigger::Request>,
+                             std::shared_ptr<std_srvs::srv::Trigger::Response> response)
+{
+  if (pretrigger_dumping) {
+    response->success = false;
+    response->message = "dump in progress";
+    return;
+  }
+  if (pretrigger_dump.joinable())
+    pretrigger_dump.join();
+
+  // dump the ring and the frames until the end of the post-trigger duration
+  const int64_t now = this->now().nanoseconds();
+  const int64_t end = now + int64_t(get_parameter("pretrigger.duration").as_double() * 1e9);
+  const std::string path =
+    get_parameter("pretrigger.directory").as_string() + "/pretrigger_" + std::to_string(now);
+
+  std::unique_ptr<FrameFileWriter> writer;
+  try {
+    writer = std::make_unique<FrameFileWriter>(path);
+  }
+  catch (const std::runtime_error &e) {
+    response->success = false;
+    response->message = e.what();
+    return;
+  }
+
+  // write on a separate thread, without blocking the capture callback
+  pretrigger_dumping = true;
+  pretrigger_dump = std::thread(&CameraNode::dumpPretrigger, this, std::move(writer), end);
+
+  response->success = true;
+  response->message = path;
+}
+
+void
+CameraNode::dumpPretrigger(std::unique_ptr<FrameFileWriter> writer, const int64_t end)
+{
+  FrameIndexEntry entry;
+  std::vector<uint8_t> data;
+  uint64_t sequence = 0;
+  // frames that were evicted from the ring before they were written or dropped by the sensor
+  uint64_t missing = 0;
+
+  try {
+    while (!pretrigger_stop) {
+      if (!pretrigger->read(sequence, entry, data)) {
+        // stop if no more frames arrive after the end of the dump
+        if (!pretrigger->wait(sequence, std::chrono::milliseconds(100)) &&
+            this->now().nanoseconds() > end)
+          break;
+        continue;
+      }
+      if (entry.timestamp > end)
+        break;
+      if (sequence && entry.sequence > sequence)
+        missing += entry.sequence - sequence;
+      writer->write(entry, data.data());
+      sequence = entry.sequence + 1;
+    }
+  }
+  catch (const std::runtime_error &e) {
+    RCLCPP_ERROR_STREAM(get_logger(), "pre-trigger dump failed: " << e.what());
+  }
+
+  RCLCPP_INFO_STREAM(get_logger(), "pre-trigger dump: " << writer->frames() << " frames, "
+                                                        << writer->bytes() / 1e6 << " MB, "
+                                                        << missing << " missing");
+  pretrigger_dumping = false;
+}
+
+void
+CameraNode::diagnosePretrigger(diagnostic_updater::DiagnosticStatusWrapper &status)
+{
+  status.summary(diagnostic_msgs::msg::DiagnosticStatus::OK,
+                 pretrigger_dumping ? "dumping" : "recording");
+  status.add("frames", pretrigger->frames());
+  status.add("size (MB)", pretrigger->bytes() / 1e6);
+  status.add("duration (s)", pretrigger->duration() * 1e-9);
+}
+
+void
+CameraNode::onRecord(const std::shared_ptr<std_srvs::srv::SetBool::Request> request,
+                     std::shared_ptr<std_srvs::srv::SetBool::Response> response)
+{
+  std::unique_lock<std::mutex> guard(recorder_lock);
+
+  if (!request->data) {
+    if (!recorder) {
+      response->success = false;
+      response->message = "not recording";
+      return;
+    }
+    // flush the buffered frames without blocking the capture callback
+    std::unique_ptr<FrameRecorder> stopped = std::move(recorder);
+    guard.unlock();
+    const FrameRecorder::Statistics stats = stopped->statistics();
+    stopped.reset();
+    std::ostringstream msg;
+    msg << stats.frames << " frames, " << stats.bytes / 1e6 << " MB in " << stats.segments
+        << " segments, " << stats.dropped << " dropped";
+    RCLCPP_INFO_STREAM(get_logger(), "recording stopped: " << msg.str());
+    response->success = true;
+    response->message = msg.str();
+    return;
+  }
+
+  if (recorder) {
+    response->success = false;
+    response->message = "already recording";
+    return;
+  }
+  if (buffer_info.empty()) {
+    response->success = false;
+    response->message = "camera not configured";
+    return;
+  }
+
+  // staging slots for the largest buffer
+  std::size_t frame_size_max = 0;
+  for (const auto &[buffer, info] : buffer_info)
+    frame_size_max = std::max(frame_size_max, info.size);
+
+  const std::string prefix = get_parameter("record.directory").as_string() + "/record_" +
+                             std::to_string(this->now().nanoseconds());
+  try {
+    recorder = std::make_unique<FrameRecorder>(
+      prefix, get_parameter("record.segment_size").as_int(), frame_size_max,
+      get_parameter("record.buffers").as_int(), huge_pages, memory_lock);
+  }
+  catch (const std::runtime_error &e) {
+    response->success = false;
+    response->message = e.what();
+    return;
+  }
+
+  RCLCPP_INFO_STREAM(get_logger(), "recording to " << prefix);
+  response->success = true;
+  response->message = prefix;
+}
+
+void
+CameraNode::diagnoseRecorder(diagnostic_updater::DiagnosticStatusWrapper &status)
+{
+  std::lock_guard<std::mutex> guard(recorder_lock);
+  if (!recorder) {
+    status.summary(diagnostic_msgs::msg::DiagnosticStatus::OK, "idle");
+    return;
+  }
+
+  const FrameRecorder::Statistics stats = recorder->statistics();
+  if (!stats.error.empty())
+    status.summary(diagnostic_msgs::msg::DiagnosticStatus::ERROR, stats.error);
+  else if (stats.dropped)
+    status.summary(diagnostic_msgs::msg::DiagnosticStatus::WARN, "recording, frames dropped");
+  else
+    status.summary(diagnostic_msgs::msg::DiagnosticStatus::OK, "recording");
+
+  status.add("frames", stats.frames);
+  status.add("dropped", stats.dropped);
+  status.add("segments", stats.segments);
+  status.add("direct I/O", stats.direct);
+  // throughput of the writes alone, and sustained over the recording
+  status.add("write throughput (MB/s)",
+             stats.time_write > 0 ? stats.bytes / stats.time_write / 1e6 : 0);
+  status.add("sustained rate (MB/s)",
+             stats.time_total > 0 ? stats.bytes / stats.time_total / 1e6 : 0);
+}
+
+void
+CameraNode::applyScheduling(const ThreadScheduling &scheduling, const std::string &name)
+{
+  try {
+    apply_scheduling(scheduling);
+  }
+  catch (const std::runtime_error &e) {
+    scheduling_failed = true;
+    RCLCPP_WARN_STREAM(get_logger(), name << " thread: " << e.what());
+  }
+}
+
+void
+CameraNode::diagnoseScheduling(diagnostic_updater::DiagnosticStatusWrapper &status)
+{
+  if (scheduling_failed)
+    status.summary(diagnostic_msgs::msg::DiagnosticStatus::WARN, "failed to apply scheduling");
+  else
+    status.summary(diagnostic_msgs::msg::DiagnosticStatus::OK, "scheduling applied");
+
+  // latencies since the last update, libcamera does not report when the buffer was completed,
+  // so the wakeup of the capture callback is only observable as part of the frame age
+  const LatencyMonitor::Statistics capture = frame_age.collect();
+  status.add("frame age at capture callback mean (ms)", capture.mean * 1e-6);
+  status.add("frame age at capture callback max (ms)", capture.max * 1e-6);
+
+  const LatencyMonitor::Statistics processing = workers->latency().collect();
+  status.add("worker wakeup latency mean (us)", processing.mean * 1e-3);
+  status.add("worker wakeup latency max (us)", processing.max * 1e-3);
+
+  if (jpeg_workers) {
+    const LatencyMonitor::Statistics jpeg = jpeg_workers->latency().collect();
+    status.add("JPEG worker wakeup latency mean (us)", jpeg.mean * 1e-3);
+    status.add("JPEG worker wakeup latency max (us)", jpeg.max * 1e-3);
+  }
+}
+
+void
+CameraNode::diagnoseMemory(diagnostic_updater::DiagnosticStatusWrapper &status)
+{
+  static const std::unordered_map<HugePages, std::string> huge_pages_names = {
+    {HugePages::NONE, "none"},
+    {HugePages::TRANSPARENT, "transparent"},
+    {HugePages::EXPLICIT, "explicit"},
+  };
+
+  status.summary(diagnostic_msgs::msg::DiagnosticStatus::OK,
+                 "huge pages: " + huge_pages_names.at(huge_pages) +
+                   (memory_lock ? ", locked" : ""));
+  status.add("copy kernel", copy_kernel.empty() ? "memcpy" : copy_kernel);
+  status.add("page faults per frame", page_faults.load());
+  if (tlb_misses >= 0)
+    status.add("dTLB misses per frame", tlb_misses.load());
+  else
+    status.add("dTLB misses per frame", "unavailable");
+}
+
+void
+CameraNode::selectCopyKernel(const uint8_t *data, const std::size_t size)
+{
+  // cached memory of the same size for comparison with the camera buffer, the comparison is
+  // only informative and skipped if memfd is not available, e.g. in a sandbox
+  void *cached = MAP_FAILED;
+  const int fd = memfd_create("copy_benchmark", MFD_CLOEXEC);
+  if (fd >= 0) {
+    if (!ftruncate(fd, size))
+      cached = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+  }
+  if (cached == MAP_FAILED)
+    RCLCPP_WARN_STREAM(get_logger(), "no memfd for copy kernel comparison: "
+                                       << std::strerror(errno));
+  else
+    std::memset(cached, 0, size);
+
+  try {
+    std::vector<uint8_t> dst(size);
+    double throughput_max = 0;
+    std::ostringstream results;
+    for (const CopyKernel &kernel : copy_kernels()) {
+      const double throughput = benchmark_copy_kernel(kernel, dst.data(), data, size, 5);
+      results << std::endl << "  " << kernel.name << ": " << throughput / 1e6 << " MB/s";
+      if (cached != MAP_FAILED) {
+        const double throughput_cached = benchmark_copy_kernel(
+          kernel, dst.data(), static_cast<const uint8_t *>(cached), size, 5);
+        results << " (camera buffer), " << throughput_cached / 1e6 << " MB/s (memfd)";
+      }
+      if (throughput > throughput_max) {
+        throughput_max = throughput;
+        copy_kernel = kernel.name;
+      }
+    }
+    RCLCPP_INFO_STREAM(get_logger(), "copy kernels:" << results.str() << std::endl
+                                                     << "selected: " << copy_kernel);
+  }
+  catch (const std::exception &e) {
+    // the selection is an optimisation, copy with 'memcpy' instead
+    RCLCPP_WARN_STREAM(get_logger(), "copy kernel selection failed: " << e.what());
+    copy_kernel = copy_kernels().front().name;
+  }
+  if (cached != MAP_FAILED)
+    munmap(cached, size);
+
+  set_copy_kernel(get_copy_kernel(copy_kernel));
+}
+
+void
+CameraNode::onControls(const camera_ros::msg::Controls::ConstSharedPtr msg)
+{
+  // the camera is only set in the configured states and 'releaseCamera' resets it under this
+  // lock, check the state before accessing the camera
+  std::lock_guard<std::mutex> guard(control_commands_lock);
+  const uint8_t state = get_current_state().id();
+  if ((state != lifecycle_msgs::msg::State::PRIMARY_STATE_INACTIVE &&
+       state != lifecycle_msgs::msg::State::PRIMARY_STATE_ACTIVE) ||
+      !camera)
+  {
+    RCLCPP_WARN_STREAM(get_logger(), "controls ignored without configured camera");
+    return;
+  }
+
+  const camera_ros::msg::ControlList &controls = msg->controls;
+  if (!controls.sizes.empty() && controls.sizes.size() != controls.ids.size()) {
+    RCLCPP_ERROR_STREAM(get_logger(), "number of control sizes and ids differ");
+    return;
+  }
+
+  const libcamera::ControlIdMap &idmap = camera->controls().idmap();
+  const std::chrono::steady_clock::time_point received = std::chrono::steady_clock::now();
+
+  std::size_t offset = 0;
+  for (std::size_t i = 0; i < controls.ids.size(); i++) {
+    const std::size_t n = controls.sizes.empty() ? 1 : controls.sizes[i];
+    if (offset + n > controls.values.size()) {
+      RCLCPP_ERROR_STREAM(get_logger(), "missing control values");
+      return;
+    }
+
+    const auto id = idmap.find(controls.ids[i]);
+    if (id == idmap.end()) {
+      RCLCPP_ERROR_STREAM(get_logger(), "unknown control id " << controls.ids[i]);
+    }
+    else {
+      std::size_t extent;
+      try {
+        extent = get_extent(id->second);
+      }
+      catch (const std::runtime_error &e) {
+        // skip controls without known extent, e.g. vendor or draft controls
+        RCLCPP_ERROR_STREAM(get_logger(), e.what());
+        offset += n;
+        continue;
+      }
+
+      const libcamera::ControlValue value =
+        values_to_cv(&controls.values[offset], n, id->second->type(), extent);
+      if (value.isNone())
+        RCLCPP_ERROR_STREAM(get_logger(), "invalid values for control " << id->second->name());
+      else
+        control_commands.push_back({msg->sequence, id->first, value, received});
+    }
+    offset += n;
+  }
+}
+
+void
+CameraNode::measureControlLatency(const libcamera::ControlList &metadata)
+{
+  std::lock_guard<std::mutex> guard(control_commands_lock);
+  if (control_commands_applied.empty())
+    return;
+
+  const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  std::vector<double> expected, actual;
+  for (auto it = control_commands_applied.begin(); it != control_commands_applied.end();) {
+    bool matched = false;
+    if (metadata.contains(it->id)) {
+      // reported values are quantised by the sensor, e.g. the exposure time to lines
+      expected.clear();
+      actual.clear();
+      cv_to_values(it->value, expected);
+      cv_to_values(metadata.get(it->id), actual);
+      matched = expected.size() == actual.size();
+      for (std::size_t i = 0; matched && i < expected.size(); i++)
+        matched = std::abs(actual[i] - expected[i]) <= std::max(1.0, 0.02 * std::abs(expected[i]));
+    }
+
+    // wait for the value for up to a second
+    if (!matched && now - it->received < std::chrono::seconds(1)) {
+      ++it;
+      continue;
+    }
+
+    if (matched)
+      control_latency.add(std::chrono::nanoseconds(now - it->received).count());
+    else
+      control_unmatched++;
+    it = control_commands_applied.erase(it);
+  }
+}
+
+void
+CameraNode::diagnoseControls(diagnostic_updater::DiagnosticStatusWrapper &status)
+{
+  const LatencyMonitor::Statistics latency = control_latency.collect();
+  status.summary(diagnostic_msgs::msg::DiagnosticStatus::OK,
+                 std::to_string(latency.count) + " controls applied");
+  status.add("round trip mean (ms)", latency.mean * 1e-6);
+  status.add("round trip max (ms)", latency.max * 1e-6);
+  // controls that are not reported in the metadata or with a different value
+  status.add("unmatched", control_unmatched.load());
+}
+
+void
+CameraNode::describeMetadata()
+{
+  metadata_descriptors = {};
+  metadata_index.clear();
+  const auto add = [this](const libcamera::ControlId *id) {
+    if (!metadata_index.emplace(id->id(), metadata_descriptors.ids.size()).second)
+      return;
+    metadata_descriptors.ids.push_back(id->id());
+    metadata_descriptors.names.push_back(id->name());
+    metadata_descriptors.types.push_back(id->type());
+  };
+
+  // controls of the camera, including vendor controls, and the controls that are only
+  // reported in the metadata, such as 'SensorTimestamp'
+  if (camera) {
+    for (const auto &[id, control] : camera->controls().idmap())
+      add(control);
+  }
+  for (const auto &[id, control] : libcamera::controls::controls)
+    add(control);
+
+  // capacity for scalars and rectangles of all controls, before the first frame
+  const std::size_t n = metadata_descriptors.ids.size();
+  metadata_msg.controls.ids.reserve(n);
+  metadata_msg.controls.sizes.reserve(n);
+  metadata_msg.controls.values.reserve(4 * n);
+}
+
+void
+CameraNode::publishMetadata(const libcamera::ControlList &metadata, const FrameIndexEntry &frame)
+{
+  // the metadata of consecutive frames has the same controls, such that the arrays of the
+  // reused message only grow on the first frames
+  camera_ros::msg::FrameMetadata &msg = metadata_msg;
+  msg.header.stamp = rclcpp::Time(frame.timestamp);
+  msg.header.frame_id = "camera";
+  msg.sequence = frame.sequence;
+
+  camera_ros::msg::ControlList &controls = msg.controls;
+  controls.ids.clear();
+  controls.sizes.clear();
+  controls.values.clear();
+  for (const auto &[id, value] : metadata) {
+    // skip controls that subscribers cannot interpret without a descriptor
+    const auto descriptor = metadata_index.find(id);
+    if (descriptor == metadata_index.end() ||
+        metadata_descriptors.types[descriptor->second] != value.type())
+      continue;
+    controls.ids.push_back(id);
+    controls.sizes.push_back(cv_to_values(value, controls.values));
+  }
+
+  // published without a copy, unless intra-process communication is enabled
+  pub_metadata->publish(msg);
+}
+
+void
+CameraNode::onSetRegions(const std::shared_ptr<camera_ros::srv::SetRegions::Request> request,
+                         std::shared_ptr<camera_ros::srv::SetRegions::Response> response)
+{
+  if (request->scaler_crop) {
+    setScalerCrop(request->regions, *response);
+    if (!response->success)
+      return;
+  }
+
+  std::lock_guard<std::mutex> guard(regions_lock);
+  regions = request->scaler_crop ? std::vector<sensor_msgs::msg::RegionOfInterest>()
+                                 : request->regions;
+
+  // publishers are kept for the lifetime of the node once created
+  while (pub_regions.size() < regions.size()) {
+    auto pub = this->create_publisher<sensor_msgs::msg::Image>(
+      "~/roi_" + std::to_string(pub_regions.size()) + "/image_raw", 1);
+    if (get_current_state().id() == lifecycle_msgs::msg::State::PRIMARY_STATE_ACTIVE)
+      pub->on_activate();
+    pub_regions.push_back(pub);
+  }
+
+  if (!request->scaler_crop) {
+    response->success = true;
+    response->message = std::to_string(regions.size()) + " regions";
+  }
+}
+
+void
+CameraNode::setScalerCrop(const std::vector<sensor_msgs::msg::RegionOfInterest> &regions,
+                          camera_ros::srv::SetRegions::Response &response)
+{
+  response.success = false;
+  if (regions.size() > 1) {
+    response.message = "ScalerCrop supports a single region";
+    return;
+  }
+  if (!camera || !stream || !parameter_ids.count("ScalerCrop")) {
+    response.message = "camera does not support ScalerCrop";
+    return;
+  }
+
+  // full sensor area, or the region mapped from the stream to the current crop
+  const libcamera::ControlInfo &info = camera->controls().at(&libcamera::controls::ScalerCrop);
+  const libcamera::Rectangle sensor = info.max().get<libcamera::Rectangle>();
+  libcamera::Rectangle crop = sensor;
+  if (!regions.empty()) {
+    const sensor_msgs::msg::RegionOfInterest &roi = regions[0];
+    const libcamera::Size size = stream->configuration().size;
+    std::unique_lock<std::mutex> guard(regions_lock);
+    const libcamera::Rectangle current = scaler_crop.isNull() ? sensor : scaler_crop;
+    guard.unlock();
+    // an empty region extends to the end of the image, as in 'crop_image'
+    const uint64_t width = roi.width ? roi.width : size.width - std::min(roi.x_offset, size.width);
+    const uint64_t height =
+      roi.height ? roi.height : size.height - std::min(roi.y_offset, size.height);
+    crop.x = current.x + int64_t(roi.x_offset) * current.width / size.width;
+    crop.y = current.y + int64_t(roi.y_offset) * current.height / size.height;
+    crop.width = width * current.width / size.width;
+    crop.height = height * current.height / size.height;
+
+    // clip to the sensor area
+    crop = crop.boundedTo(sensor);
+    if (!crop.width || !crop.height) {
+      response.message = "region outside of the sensor area";
+      return;
+    }
+  }
+
+  const rcl_interfaces::msg::SetParametersResult result = set_parameter(rclcpp::Parameter(
+    "ScalerCrop", std::vector<int64_t> {crop.x, crop.y, crop.width, crop.height}));
+  response.success = result.successful;
+  response.message = result.successful ? "ScalerCrop " + crop.toString() : result.reason;
+}
+
+void
+CameraNode::publishStatistics(const std_msgs::msg::Header &hdr, const FrameIndexEntry &frame,
+                              const uint8_t *data, const FormatType type)
+{
+  const std::string encoding = get_frame_format(frame);
+  const uint32_t grid = statistics_grid;
+  // distance of the samples in the decoded image
+  uint32_t grid_image = grid;
+  ImageView image = {data, frame.width, frame.height, frame.step, encoding};
+
+  if (type == FormatType::COMPRESSED) {
+    // decode at 1/8 of the size with the scaled inverse DCT and sample the reduced image
+    thread_local std::vector<uint8_t> pixels;
+    try {
+      image = decode_jpeg(data, frame.size, 8, pixels);
+    }
+    catch (const std::runtime_error &e) {
+      RCLCPP_WARN_STREAM(get_logger(), "statistics: " << e.what());
+      return;
+    }
+    grid_image = std::max<uint32_t>(grid / 8, 1);
+  }
+  else if (!statistics_supported(encoding)) {
+    RCLCPP_WARN_STREAM_ONCE(get_logger(), "statistics of " << encoding << " not supported");
+    return;
+  }
+
+  ImageStatistics statistics;
+  compute_statistics(image, grid_image, statistics);
+
+  auto msg = std::make_unique<camera_ros::msg::ImageStatistics>();
+  msg->header = hdr;
+  msg->grid = type == FormatType::COMPRESSED ? 8 * grid_image : grid;
+  msg->samples = statistics.samples;
+  std::copy(statistics.histogram.begin(), statistics.histogram.end(), msg->histogram.begin());
+  msg->channels = statistics.channels;
+  msg->means.assign(statistics.means.begin(),
+                    statistics.means.begin() + statistics.channels.size());
+  msg->clipped_low = statistics.clipped_low;
+  msg->clipped_high = statistics.clipped_high;
+  msg->sharpness = statistics.sharpness;
+  pub_statistics->publish(std::move(msg));
+}
+
+bool
+CameraNode::detectChange(const FrameIndexEntry &frame, const uint8_t *data, const FormatType type)
+{
+  if (change_threshold <= 0)
+    return true;
+
+  const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+  // signatures straight from the mapped buffer, or from the JPEG decoded at 1/8 of the size
+  ImageView image = {data, frame.width, frame.height, frame.step, get_frame_format(frame)};
+  if (type == FormatType::COMPRESSED) {
+    thread_local std::vector<uint8_t> pixels;
+    try {
+      image = decode_jpeg(data, frame.size, 8, pixels);
+    }
+    catch (const std::runtime_error &e) {
+      RCLCPP_WARN_STREAM(get_logger(), "change detection: " << e.what());
+      return true;
+    }
+  }
+  change_detector.set_block_threshold(change_block_threshold);
+  const double change = change_detector.update(image);
+
+  const double cost =
+    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+  change_cost = 0.9 * change_cost + 0.1 * cost;
+  change_cost_max = std::max(change_cost_max.load(), cost);
+  change_last = change;
+
+  if (change >= change_threshold ||
+      (change_heartbeat > 0 && frame.timestamp - change_passed >= change_heartbeat * 1e9))
+  {
+    change_passed = frame.timestamp;
+    return true;
+  }
+
+  change_suppressed++;
+  return false;
+}
+
+void
+CameraNode::diagnoseChange(diagnostic_updater::DiagnosticStatusWrapper &status)
+{
+  if (change_threshold <= 0) {
+    status.summary(diagnostic_msgs::msg::DiagnosticStatus::OK, "disabled");
+    return;
+  }
+
+  status.summary(diagnostic_msgs::msg::DiagnosticStatus::OK,
+                 std::to_string(change_suppressed.load()) + " frames suppressed");
+  status.add("changed blocks", change_last.load());
+  status.add("detection time (ms)", change_cost.load());
+  status.add("detection time max (ms)", change_cost_max.exchange(0));
+  status.add("suppressed", change_suppressed.load());
+}
+
 } // namespace camera
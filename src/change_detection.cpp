@@ -0,0 +1,118 @@
+#include "change_detection.hpp"
+#include <algorithm>
+#include <cmath>
+#include <sensor_msgs/image_encodings.hpp>
+#include <stdexcept>
+#if defined(__SSE2__) && defined(__x86_64__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+
+static constexpr uint32_t blocks = 16;
+static constexpr uint32_t rows_per_block = 8;
+
+// sum of 'n' bytes
+static uint64_t
+sum_bytes(const uint8_t *p, const std::size_t n)
+{
+  uint64_t sum = 0;
+  std::size_t i = 0;
+#if defined(__SSE2__) && defined(__x86_64__)
+  // sums of absolute differences to zero add up 8 bytes per 64-bit lane
+  __m128i acc = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16)
+    acc = _mm_add_epi64(
+      acc, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i)),
+                        _mm_setzero_si128()));
+  sum = _mm_cvtsi128_si64(acc) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc));
+#elif defined(__aarch64__)
+  // pairwise widening additions into 32-bit lanes, bounded by the row length
+  uint32x4_t acc = vdupq_n_u32(0);
+  for (; i + 16 <= n; i += 16)
+    acc = vpadalq_u16(acc, vpaddlq_u8(vld1q_u8(p + i)));
+  sum = vaddvq_u32(acc);
+#endif
+  for (; i < n; i++)
+    sum += p[i];
+  return sum;
+}
+
+// sum of 'n' 16-bit samples, vectorised by the compiler
+static uint64_t
+sum_words(const uint16_t *p, const std::size_t n)
+{
+  uint64_t sum = 0;
+  for (std::size_t i = 0; i < n; i++)
+    sum += p[i];
+  return sum;
+}
+
+ChangeDetector::ChangeDetector(const double block_threshold) : threshold(block_threshold) {}
+
+void
+ChangeDetector::set_block_threshold(const double block_threshold)
+{
+  threshold = block_threshold;
+}
+
+double
+ChangeDetector::update(const ImageView &image)
+{
+  namespace enc = sensor_msgs::image_encodings;
+
+  const bool yuv422 = image.encoding == enc::YUV422 || image.encoding == enc::YUV422_YUY2;
+  const int depth = enc::bitDepth(image.encoding);
+  const bool words = depth > 8;
+  const uint32_t row_bytes =
+    yuv422 ? image.width * 2 : image.width * enc::numChannels(image.encoding) * depth / 8;
+  const uint32_t samples = row_bytes / (words ? 2 : 1);
+  const double range = words ? 65535 : 255;
+
+  // blocks of whole samples and rows, the remainder is in the last block
+  const uint32_t block_samples = std::max<uint32_t>(samples / blocks, 1);
+  const uint32_t block_rows = std::max<uint32_t>(image.height / blocks, 1);
+  const uint32_t row_step = std::max<uint32_t>(block_rows / rows_per_block, 1);
+
+  signature.resize(blocks * blocks);
+  for (uint32_t by = 0; by < blocks; by++) {
+    uint64_t sums[blocks] = {};
+    const uint32_t row_begin = std::min(by * block_rows, image.height);
+    const uint32_t row_end = by + 1 < blocks ? std::min(row_begin + block_rows, image.height)
+                                             : image.height;
+    uint32_t rows = 0;
+    for (uint32_t row = row_begin; row < row_end; row += row_step, rows++) {
+      const uint8_t *r = image.data + std::size_t(row) * image.step;
+      for (uint32_t bx = 0; bx < blocks; bx++) {
+        const uint32_t begin = std::min(bx * block_samples, samples);
+        const uint32_t end = bx + 1 < blocks ? std::min(begin + block_samples, samples) : samples;
+        sums[bx] +=
+          words ? sum_words(reinterpret_cast<const uint16_t *>(r) + begin, end - begin)
+                : sum_bytes(r + begin, end - begin);
+      }
+    }
+    // normalised block means
+    for (uint32_t bx = 0; bx < blocks; bx++) {
+      const uint32_t begin = std::min(bx * block_samples, samples);
+      const uint32_t end = bx + 1 < blocks ? std::min(begin + block_samples, samples) : samples;
+      const double n = double(rows) * (end - begin);
+      signature[by * blocks + bx] = n ? sums[bx] / n / range : 0;
+    }
+  }
+
+  double change = 1;
+  if (image.width == width_prev && image.height == height_prev &&
+      signature_prev.size() == signature.size())
+  {
+    uint32_t changed = 0;
+    for (std::size_t i = 0; i < signature.size(); i++)
+      changed += std::abs(signature[i] - signature_prev[i]) > threshold;
+    change = double(changed) / signature.size();
+  }
+
+  std::swap(signature, signature_prev);
+  width_prev = image.width;
+  height_prev = image.height;
+  return change;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "image_view.hpp"
+#include <cstdint>
+#include <vector>
+
+
+// Detection of scene changes between consecutive frames.
+//
+// The signature of a frame is the mean sample value of each block of a 16x16 grid, computed
+// from every 8th row of a block directly in the raw buffer. Samples are bytes, or 16-bit
+// values for formats with more than 8 bits, independent of the channel layout.
+// The change of a frame is the fraction of blocks whose mean differs from the previous frame
+// by more than 'block_threshold' of the sample range.
+class ChangeDetector
+{
+public:
+  explicit ChangeDetector(const double block_threshold = 0.02);
+
+  void
+  set_block_threshold(const double block_threshold);
+
+  // fraction of changed blocks in [0, 1], 1 for the first frame or a different layout
+  double
+  update(const ImageView &image);
+
+private:
+  double threshold;
+  std::vector<float> signature;
+  std::vector<float> signature_prev;
+  uint32_t width_prev = 0;
+  uint32_t height_prev = 0;
+};
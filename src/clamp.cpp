@@ -1,3 +1,4 @@
+#include "small_buffer.hpp"
 #include "types.hpp"
 #include <algorithm>
 #include <cassert>
@@ -8,7 +9,6 @@
 #include <stdexcept>
 #include <string>
 #include <type_traits>
-#include <vector>
 
 
 #define CASE_CLAMP(T)                                                                              \
@@ -91,12 +91,12 @@ clamp_array(const libcamera::ControlValue &value, const libcamera::ControlValue
   const libcamera::Span<const T> a = min.get<libcamera::Span<const T>>();
   const libcamera::Span<const T> b = max.get<libcamera::Span<const T>>();
 
-  std::vector<T> vclamp(v.size());
+  SmallBuffer<T> vclamp(v.size());
 
   for (size_t i = 0; i < v.size(); i++)
     vclamp[i] = std::clamp(v[i], a[i], b[i]);
 
-  return libcamera::ControlValue(libcamera::Span<const T>(vclamp));
+  return libcamera::ControlValue(vclamp.span());
 }
 
 template<typename T,
@@ -0,0 +1,100 @@
+#include "control_values.hpp"
+#include "small_buffer.hpp"
+#include "types.hpp"
+#include <libcamera/base/span.h>
+#include <libcamera/controls.h>
+#include <libcamera/geometry.h>
+#include <vector>
+
+
+template<typename T>
+static libcamera::ControlValue
+values_to_cv_arithmetic(const double *values, const std::size_t n, const std::size_t extent)
+{
+  // scalars take exactly one value, fixed-size arrays exactly 'extent' values
+  if (!extent)
+    return n == 1 ? libcamera::ControlValue(T(values[0])) : libcamera::ControlValue();
+  if (extent != libcamera::dynamic_extent && n != extent)
+    return {};
+  SmallBuffer<T> array(n);
+  for (std::size_t i = 0; i < n; i++)
+    array[i] = T(values[i]);
+  return {array.span()};
+}
+
+libcamera::ControlValue
+values_to_cv(const double *values, const std::size_t n, const libcamera::ControlType &type,
+             const std::size_t extent)
+{
+  switch (type) {
+  case libcamera::ControlTypeBool:
+    return values_to_cv_arithmetic<CTBool>(values, n, extent);
+  case libcamera::ControlTypeByte:
+    return values_to_cv_arithmetic<CTByte>(values, n, extent);
+  case libcamera::ControlTypeInteger32:
+    return values_to_cv_arithmetic<CTInteger32>(values, n, extent);
+  case libcamera::ControlTypeInteger64:
+    return values_to_cv_arithmetic<CTInteger64>(values, n, extent);
+  case libcamera::ControlTypeFloat:
+    return values_to_cv_arithmetic<CTFloat>(values, n, extent);
+  case libcamera::ControlTypeRectangle:
+    if (n != 4)
+      return {};
+    return {libcamera::Rectangle(values[0], values[1], values[2], values[3])};
+  case libcamera::ControlTypeSize:
+    if (n != 2)
+      return {};
+    return {libcamera::Size(values[0], values[1])};
+  default:
+    return {};
+  }
+}
+
+template<typename T>
+static std::size_t
+cv_to_values_arithmetic(const libcamera::ControlValue &value, std::vector<double> &values)
+{
+  if (!value.isArray()) {
+    values.push_back(value.get<T>());
+    return 1;
+  }
+  const libcamera::Span<const T> span = value.get<libcamera::Span<const T>>();
+  values.insert(values.end(), span.begin(), span.end());
+  return span.size();
+}
+
+std::size_t
+cv_to_values(const libcamera::ControlValue &value, std::vector<double> &values)
+{
+  switch (value.type()) {
+  case libcamera::ControlTypeBool:
+    return cv_to_values_arithmetic<CTBool>(value, values);
+  case libcamera::ControlTypeByte:
+    return cv_to_values_arithmetic<CTByte>(value, values);
+  case libcamera::ControlTypeInteger32:
+    return cv_to_values_arithmetic<CTInteger32>(value, values);
+  case libcamera::ControlTypeInteger64:
+    return cv_to_values_arithmetic<CTInteger64>(value, values);
+  case libcamera::ControlTypeFloat:
+    return cv_to_values_arithmetic<CTFloat>(value, values);
+  case libcamera::ControlTypeRectangle:
+  {
+    // arrays of rectangles are not used by any control
+    if (value.isArray())
+      return 0;
+    const libcamera::Rectangle r = value.get<libcamera::Rectangle>();
+    values.insert(values.end(), {double(r.x), double(r.y), double(r.width), double(r.height)});
+    return 4;
+  }
+  case libcamera::ControlTypeSize:
+  {
+    if (value.isArray())
+      return 0;
+    const libcamera::Size s = value.get<libcamera::Size>();
+    values.insert(values.end(), {double(s.width), double(s.height)});
+    return 2;
+  }
+  default:
+    return 0;
+  }
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <cstddef>
+#include <libcamera/controls.h>
+#include <vector>
+
+
+// convert 'n' values to a control value of the given type and extent (0 for scalars),
+// returns 'None' for unsupported types or sizes
+libcamera::ControlValue
+values_to_cv(const double *values, const std::size_t n, const libcamera::ControlType &type,
+             const std::size_t extent);
+
+// append the elements of a control value, returns the number of appended values
+std::size_t
+cv_to_values(const libcamera::ControlValue &value, std::vector<double> &values);
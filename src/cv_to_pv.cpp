@@ -1,6 +1,7 @@
 #include "cv_to_pv.hpp"
 #include "types.hpp"
 #include <cstdint>
+#include <initializer_list>
 #include <libcamera/base/span.h>
 #include <libcamera/controls.h>
 #include <libcamera/geometry.h>
@@ -13,16 +14,47 @@
 
 #define CASE_CONVERT(T)                                                                            \
   case libcamera::ControlType##T:                                                                  \
-    return cv_to_pv(extract_value<ControlTypeMap<libcamera::ControlType##T>::type>(value), extent);
+    return cv_to_pv(get_span<ControlTypeMap<libcamera::ControlType##T>::type>(value), extent);
 
 #define CASE_NONE(T)                                                                               \
   case libcamera::ControlType##T:                                                                  \
     return {};
 
 
+// element type of the parameter array for a control type
 template<typename T>
-std::vector<T>
-extract_value(const libcamera::ControlValue &value)
+struct ParameterElement
+{
+  using type = T;
+};
+
+template<>
+struct ParameterElement<CTInteger32>
+{
+  using type = int64_t;
+};
+
+template<>
+struct ParameterElement<CTFloat>
+{
+  using type = double;
+};
+
+// view of the scalar or array elements of a value, without copying
+template<typename T, std::enable_if_t<!std::is_same<std::string, T>::value, bool> = true>
+libcamera::Span<const T>
+get_span(const libcamera::ControlValue &value)
+{
+  if (value.isArray())
+    return value.get<libcamera::Span<const T>>();
+  // scalars are stored in place
+  return {reinterpret_cast<const T *>(value.data().data()), 1};
+}
+
+// strings are not stored as 'std::string' and always have to be copied
+template<typename T, std::enable_if_t<std::is_same<std::string, T>::value, bool> = true>
+std::vector<std::string>
+get_span(const libcamera::ControlValue &value)
 {
   if (value.isArray()) {
     const libcamera::Span<const T> span = value.get<libcamera::Span<const T>>();
@@ -33,20 +65,36 @@ extract_value(const libcamera::ControlValue &value)
   }
 }
 
-template<typename T,
-         std::enable_if_t<std::is_arithmetic<T>::value || std::is_same<std::string, T>::value,
-                          bool> = true>
+// Arrays with 'n' elements, or the first element repeated 'n' times for a single element.
+// The elements are converted in a reused buffer per thread, such that only the parameter
+// value allocates its storage.
+template<typename T, std::enable_if_t<std::is_arithmetic<T>::value, bool> = true>
 rclcpp::ParameterValue
-cv_to_pv_array(const std::vector<T> &values)
+cv_to_pv_array(const libcamera::Span<const T> &values, const std::size_t n)
 {
-  return rclcpp::ParameterValue(values);
+  using P = typename ParameterElement<T>::type;
+  thread_local std::vector<P> buffer;
+  if (values.size() == 1)
+    buffer.assign(n, P(values[0]));
+  else
+    buffer.assign(values.begin(), values.end());
+  return rclcpp::ParameterValue(buffer);
+}
+
+template<typename T, std::enable_if_t<std::is_same<std::string, T>::value, bool> = true>
+rclcpp::ParameterValue
+cv_to_pv_array(const libcamera::Span<const T> &values, const std::size_t n)
+{
+  if (values.size() == 1)
+    return rclcpp::ParameterValue(std::vector<T>(n, values[0]));
+  return rclcpp::ParameterValue(std::vector<T>(values.begin(), values.end()));
 }
 
 template<typename T,
          std::enable_if_t<!std::is_arithmetic<T>::value && !std::is_same<std::string, T>::value,
                           bool> = true>
 rclcpp::ParameterValue
-cv_to_pv_array(const std::vector<T> & /*values*/)
+cv_to_pv_array(const libcamera::Span<const T> & /*values*/, const std::size_t /*n*/)
 {
   throw std::runtime_error("ParameterValue only supported for arithmetic types");
 }
@@ -60,39 +108,53 @@ cv_to_pv_scalar(const T &value)
   return rclcpp::ParameterValue(value);
 }
 
+rclcpp::ParameterValue
+cv_to_pv_int_array(const std::initializer_list<int64_t> values)
+{
+  thread_local std::vector<int64_t> buffer;
+  buffer.assign(values);
+  return rclcpp::ParameterValue(buffer);
+}
+
 rclcpp::ParameterValue
 cv_to_pv_scalar(const libcamera::Rectangle &rectangle)
 {
-  return rclcpp::ParameterValue(
-    std::vector<int64_t> {rectangle.x, rectangle.y, rectangle.width, rectangle.height});
+  return cv_to_pv_int_array({rectangle.x, rectangle.y, rectangle.width, rectangle.height});
 }
 
 rclcpp::ParameterValue
 cv_to_pv_scalar(const libcamera::Size &size)
 {
-  return rclcpp::ParameterValue(std::vector<int64_t> {size.width, size.height});
+  return cv_to_pv_int_array({size.width, size.height});
 }
 
 template<typename T>
 rclcpp::ParameterValue
-cv_to_pv(const std::vector<T> &values, const std::size_t &extent)
+cv_to_pv(const libcamera::Span<const T> &values, const std::size_t &extent)
 {
-  if ((values.size() > 1 && extent > 1) && (values.size() != extent))
+  if ((values.size() > 1 && extent > 1) && (extent != libcamera::dynamic_extent) &&
+      (values.size() != extent))
     throw std::runtime_error("type extent (" + std::to_string(extent) + ") and value size (" +
                              std::to_string(values.size()) +
                              ") cannot be larger than 1 and differ");
 
   if (values.size() > 1)
-    return cv_to_pv_array(values);
+    return cv_to_pv_array(values, values.size());
   else if (values.size() == 1)
     if (!extent)
       return cv_to_pv_scalar(values[0]);
     else
-      return cv_to_pv_array(std::vector<T>(extent, values[0]));
+      return cv_to_pv_array(values, extent == libcamera::dynamic_extent ? 1 : extent);
   else
     return rclcpp::ParameterValue();
 }
 
+rclcpp::ParameterValue
+cv_to_pv(const std::vector<std::string> &values, const std::size_t &extent)
+{
+  return cv_to_pv(libcamera::Span<const std::string>(values), extent);
+}
+
 rclcpp::ParameterValue
 cv_to_pv(const libcamera::ControlValue &value, const std::size_t &extent)
 {
@@ -4,6 +4,9 @@
 #include <rclcpp/parameter_value.hpp>
 
 
+// Convert a control value to a parameter value. Elements are read from the control value
+// without copying. The parameter value owns its storage, so converting a string or an array,
+// including rectangles, sizes and broadcast scalars, allocates that storage once.
 rclcpp::ParameterValue
 cv_to_pv(const libcamera::ControlValue &value, const std::size_t &extent);
 
@@ -0,0 +1,174 @@
+#include "frame_copy.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse4.1"))) static void
+copy_sse41(void *dst, const void *src, std::size_t size)
+{
+  uint8_t *d = static_cast<uint8_t *>(dst);
+  const uint8_t *s = static_cast<const uint8_t *>(src);
+
+  // align the destination for non-temporal stores
+  const std::size_t head = std::min(size, (16 - (uintptr_t(d) & 15)) & 15);
+  std::memcpy(d, s, head);
+  d += head;
+  s += head;
+  size -= head;
+
+  // streaming loads require an aligned source, mapped buffers are page-aligned
+  const bool aligned = !(uintptr_t(s) & 15);
+  for (; size >= 64; size -= 64, s += 64, d += 64) {
+    __m128i a, b, c, e;
+    if (aligned) {
+      a = _mm_stream_load_si128(reinterpret_cast<__m128i *>(const_cast<uint8_t *>(s)));
+      b = _mm_stream_load_si128(reinterpret_cast<__m128i *>(const_cast<uint8_t *>(s + 16)));
+      c = _mm_stream_load_si128(reinterpret_cast<__m128i *>(const_cast<uint8_t *>(s + 32)));
+      e = _mm_stream_load_si128(reinterpret_cast<__m128i *>(const_cast<uint8_t *>(s + 48)));
+    }
+    else {
+      a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+      b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + 16));
+      c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + 32));
+      e = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + 48));
+    }
+    _mm_stream_si128(reinterpret_cast<__m128i *>(d), a);
+    _mm_stream_si128(reinterpret_cast<__m128i *>(d + 16), b);
+    _mm_stream_si128(reinterpret_cast<__m128i *>(d + 32), c);
+    _mm_stream_si128(reinterpret_cast<__m128i *>(d + 48), e);
+  }
+  _mm_sfence();
+
+  std::memcpy(d, s, size);
+}
+
+__attribute__((target("avx2"))) static void
+copy_avx2(void *dst, const void *src, std::size_t size)
+{
+  uint8_t *d = static_cast<uint8_t *>(dst);
+  const uint8_t *s = static_cast<const uint8_t *>(src);
+
+  const std::size_t head = std::min(size, (32 - (uintptr_t(d) & 31)) & 31);
+  std::memcpy(d, s, head);
+  d += head;
+  s += head;
+  size -= head;
+
+  const bool aligned = !(uintptr_t(s) & 31);
+  for (; size >= 128; size -= 128, s += 128, d += 128) {
+    __m256i a, b, c, e;
+    if (aligned) {
+      a = _mm256_stream_load_si256(reinterpret_cast<const __m256i *>(s));
+      b = _mm256_stream_load_si256(reinterpret_cast<const __m256i *>(s + 32));
+      c = _mm256_stream_load_si256(reinterpret_cast<const __m256i *>(s + 64));
+      e = _mm256_stream_load_si256(reinterpret_cast<const __m256i *>(s + 96));
+    }
+    else {
+      a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+      b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + 32));
+      c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + 64));
+      e = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + 96));
+    }
+    _mm256_stream_si256(reinterpret_cast<__m256i *>(d), a);
+    _mm256_stream_si256(reinterpret_cast<__m256i *>(d + 32), b);
+    _mm256_stream_si256(reinterpret_cast<__m256i *>(d + 64), c);
+    _mm256_stream_si256(reinterpret_cast<__m256i *>(d + 96), e);
+  }
+  _mm_sfence();
+
+  std::memcpy(d, s, size);
+}
+#endif
+
+#if defined(__aarch64__)
+static void
+copy_neon(void *dst, const void *src, std::size_t size)
+{
+  uint8_t *d = static_cast<uint8_t *>(dst);
+  const uint8_t *s = static_cast<const uint8_t *>(src);
+
+  // non-temporal load and store pairs of 64 bytes
+  for (; size >= 64; size -= 64, s += 64, d += 64) {
+    asm volatile("ldnp q0, q1, [%0]\n"
+                 "ldnp q2, q3, [%0, #32]\n"
+                 "stnp q0, q1, [%1]\n"
+                 "stnp q2, q3, [%1, #32]\n"
+                 :
+                 : "r"(s), "r"(d)
+                 : "v0", "v1", "v2", "v3", "memory");
+  }
+
+  std::memcpy(d, s, size);
+}
+#endif
+
+static void
+copy_memcpy(void *dst, const void *src, std::size_t size)
+{
+  std::memcpy(dst, src, size);
+}
+
+const std::vector<CopyKernel> &
+copy_kernels()
+{
+  static const std::vector<CopyKernel> kernels = []() {
+    std::vector<CopyKernel> kernels = {{"memcpy", copy_memcpy}};
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("sse4.1"))
+      kernels.push_back({"sse4.1", copy_sse41});
+    if (__builtin_cpu_supports("avx2"))
+      kernels.push_back({"avx2", copy_avx2});
+#endif
+#if defined(__aarch64__)
+    kernels.push_back({"neon", copy_neon});
+#endif
+    return kernels;
+  }();
+  return kernels;
+}
+
+const CopyKernel &
+get_copy_kernel(const std::string &name)
+{
+  for (const CopyKernel &kernel : copy_kernels())
+    if (kernel.name == name)
+      return kernel;
+  throw std::runtime_error("copy kernel \"" + name + "\" is not supported");
+}
+
+double
+benchmark_copy_kernel(const CopyKernel &kernel, uint8_t *dst, const uint8_t *src,
+                      const std::size_t size, const std::size_t repetitions)
+{
+  double time_min = 0;
+  for (std::size_t i = 0; i < repetitions; i++) {
+    const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    kernel.copy(dst, src, size);
+    const double time =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (!i || time < time_min)
+      time_min = time;
+  }
+  return time_min > 0 ? size / time_min : 0;
+}
+
+static std::atomic<void (*)(void *, const void *, std::size_t)> kernel_selected = copy_memcpy;
+
+void
+set_copy_kernel(const CopyKernel &kernel)
+{
+  kernel_selected = kernel.copy;
+}
+
+void
+copy_frame(void *dst, const void *src, const std::size_t size)
+{
+  kernel_selected.load(std::memory_order_relaxed)(dst, src, size);
+}
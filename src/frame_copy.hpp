@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// Copy kernels for frame buffers. Camera buffers are often mapped uncached or
+// write-combined, where streaming loads are considerably faster than regular loads,
+// and non-temporal stores avoid evicting the cache for the destination.
+struct CopyKernel
+{
+  std::string name;
+  void (*copy)(void *dst, const void *src, std::size_t size);
+};
+
+// kernels supported by the CPU, starting with the plain 'memcpy'
+const std::vector<CopyKernel> &
+copy_kernels();
+
+// supported kernel by name, throws if the CPU does not support it
+const CopyKernel &
+get_copy_kernel(const std::string &name);
+
+// copy throughput (bytes/s) of a kernel, as the best of several repetitions
+double
+benchmark_copy_kernel(const CopyKernel &kernel, uint8_t *dst, const uint8_t *src,
+                      const std::size_t size, const std::size_t repetitions);
+
+// select the kernel used by 'copy_frame'
+void
+set_copy_kernel(const CopyKernel &kernel);
+
+// copy frame data with the selected kernel
+void
+copy_frame(void *dst, const void *src, const std::size_t size);
@@ -0,0 +1,183 @@
+#include "frame_file.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+static constexpr uint32_t magic = 0x58444946; // "FIDX"
+static constexpr uint16_t version = 1;
+
+static void
+write_all(const int fd, const void *data, const std::size_t size, const std::string &path)
+{
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  std::size_t written = 0;
+  while (written < size) {
+    const ssize_t n = ::write(fd, p + written, size - written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      throw std::runtime_error("failed to write \"" + path + "\": " + std::strerror(errno));
+    written += n;
+  }
+}
+
+void
+set_frame_format(FrameIndexEntry &entry, const std::string &format)
+{
+  if (format.size() >= sizeof(entry.format))
+    throw std::runtime_error("frame format too long: \"" + format + "\"");
+  std::memset(entry.format, 0, sizeof(entry.format));
+  std::memcpy(entry.format, format.data(), format.size());
+}
+
+std::string
+get_frame_format(const FrameIndexEntry &entry)
+{
+  return std::string(entry.format, strnlen(entry.format, sizeof(entry.format)));
+}
+
+FrameIndexHeader
+make_frame_index_header()
+{
+  return {magic, version, sizeof(FrameIndexEntry)};
+}
+
+void
+check_frame_index_header(const FrameIndexHeader &header)
+{
+  if (header.magic != magic || header.version != version ||
+      header.entry_size != sizeof(FrameIndexEntry))
+    throw std::runtime_error("invalid frame index header");
+}
+
+FrameFileWriter::FrameFileWriter(const std::string &path)
+{
+  fd_data = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_data < 0)
+    throw std::runtime_error("failed to open \"" + path + "\": " + std::strerror(errno));
+
+  const std::string path_index = path + ".index";
+  fd_index = ::open(path_index.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_index < 0) {
+    ::close(fd_data);
+    throw std::runtime_error("failed to open \"" + path_index + "\": " + std::strerror(errno));
+  }
+
+  const FrameIndexHeader header = make_frame_index_header();
+  write_all(fd_index, &header, sizeof(header), path_index);
+}
+
+FrameFileWriter::~FrameFileWriter()
+{
+  // pad the data file to the aligned end of the last frame
+  if (ftruncate(fd_data, offset)) {
+    // keep the unpadded file
+  }
+  ::close(fd_data);
+  ::close(fd_index);
+}
+
+void
+FrameFileWriter::write(FrameIndexEntry entry, const uint8_t *data)
+{
+  if (lseek(fd_data, offset, SEEK_SET) < 0)
+    throw std::runtime_error(std::string("failed to seek frame file: ") + std::strerror(errno));
+  write_all(fd_data, data, entry.size, "frame file");
+
+  entry.offset = offset;
+  write_all(fd_index, &entry, sizeof(entry), "frame index");
+
+  offset += (entry.size + frame_file_alignment - 1) / frame_file_alignment * frame_file_alignment;
+  count++;
+}
+
+uint64_t
+FrameFileWriter::frames() const
+{
+  return count;
+}
+
+uint64_t
+FrameFileWriter::bytes() const
+{
+  return offset;
+}
+
+FrameFileReader::FrameFileReader(const std::string &path)
+{
+  const std::string path_index = path + ".index";
+  std::ifstream index(path_index, std::ios::binary);
+  if (!index)
+    throw std::runtime_error("failed to open \"" + path_index + "\"");
+
+  FrameIndexHeader header;
+  if (!index.read(reinterpret_cast<char *>(&header), sizeof(header)))
+    throw std::runtime_error("failed to read \"" + path_index + "\"");
+  check_frame_index_header(header);
+
+  FrameIndexEntry entry;
+  while (index.read(reinterpret_cast<char *>(&entry), sizeof(entry)))
+    entries.push_back(entry);
+
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error("failed to open \"" + path + "\": " + std::strerror(errno));
+  struct stat st;
+  if (fstat(fd, &st)) {
+    const int err = errno;
+    ::close(fd);
+    throw std::runtime_error("failed to stat \"" + path + "\": " + std::strerror(err));
+  }
+  mapping_size = st.st_size;
+
+  // the frames of a recording that was not closed may exceed the file size
+  for (const FrameIndexEntry &e : entries)
+    if (e.offset + e.size > mapping_size) {
+      ::close(fd);
+      throw std::runtime_error("frame " + std::to_string(e.sequence) + " exceeds \"" + path +
+                               "\"");
+    }
+
+  if (mapping_size) {
+    void *p = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      const int err = errno;
+      ::close(fd);
+      throw std::runtime_error("failed to map \"" + path + "\": " + std::strerror(err));
+    }
+    mapping = static_cast<uint8_t *>(p);
+    // frames are read sequentially
+    madvise(mapping, mapping_size, MADV_SEQUENTIAL);
+  }
+  ::close(fd);
+}
+
+FrameFileReader::~FrameFileReader()
+{
+  if (mapping)
+    munmap(mapping, mapping_size);
+}
+
+std::size_t
+FrameFileReader::frames() const
+{
+  return entries.size();
+}
+
+const FrameIndexEntry &
+FrameFileReader::entry(const std::size_t i) const
+{
+  return entries.at(i);
+}
+
+const uint8_t *
+FrameFileReader::data(const std::size_t i) const
+{
+  return mapping + entries.at(i).offset;
+}
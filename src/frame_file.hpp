@@ -0,0 +1,105 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// A frame file stores the payload of consecutive frames in a data file at offsets aligned to
+// 'frame_file_alignment', and one fixed-size entry per frame in the index file "<path>.index".
+static constexpr std::size_t frame_file_alignment = 4096;
+
+struct FrameIndexHeader
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t entry_size;
+};
+
+struct FrameIndexEntry
+{
+  uint64_t sequence;
+  // system time (ns)
+  int64_t timestamp;
+  // location of the payload in the data file
+  uint64_t offset;
+  uint32_t size;
+  uint32_t width;
+  uint32_t height;
+  uint32_t step;
+  // ROS image encoding or compressed format, zero-terminated
+  char format[32];
+};
+
+void
+set_frame_format(FrameIndexEntry &entry, const std::string &format);
+
+std::string
+get_frame_format(const FrameIndexEntry &entry);
+
+// header of an index file in the current version
+FrameIndexHeader
+make_frame_index_header();
+
+// throws if the header of an index file does not match the current version
+void
+check_frame_index_header(const FrameIndexHeader &header);
+
+// Append frames to a frame file with buffered writes.
+class FrameFileWriter
+{
+public:
+  explicit FrameFileWriter(const std::string &path);
+
+  ~FrameFileWriter();
+
+  FrameFileWriter(const FrameFileWriter &) = delete;
+
+  FrameFileWriter &
+  operator=(const FrameFileWriter &) = delete;
+
+  // append the payload of a frame, the offset of the entry is set by the writer
+  void
+  write(FrameIndexEntry entry, const uint8_t *data);
+
+  uint64_t
+  frames() const;
+
+  uint64_t
+  bytes() const;
+
+private:
+  int fd_data = -1;
+  int fd_index = -1;
+  uint64_t offset = 0;
+  uint64_t count = 0;
+};
+
+// Read frames from a frame file that is memory-mapped read-only, without copying the payload.
+class FrameFileReader
+{
+public:
+  explicit FrameFileReader(const std::string &path);
+
+  ~FrameFileReader();
+
+  FrameFileReader(const FrameFileReader &) = delete;
+
+  FrameFileReader &
+  operator=(const FrameFileReader &) = delete;
+
+  std::size_t
+  frames() const;
+
+  const FrameIndexEntry &
+  entry(const std::size_t i) const;
+
+  // payload of a frame, valid for the lifetime of the reader
+  const uint8_t *
+  data(const std::size_t i) const;
+
+private:
+  std::vector<FrameIndexEntry> entries;
+  uint8_t *mapping = nullptr;
+  std::size_t mapping_size = 0;
+};
@@ -0,0 +1,196 @@
+#include "frame_memory.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <utility>
+
+
+// default size of explicit huge pages, e.g. 2 MiB on x86-64 and 512 MiB on arm64 with 64 KiB
+// pages, 0 if the kernel does not support them
+static std::size_t
+get_huge_page_size_explicit()
+{
+  std::ifstream meminfo("/proc/meminfo");
+  std::string key;
+  std::size_t size;
+  while (meminfo >> key) {
+    if (key == "Hugepagesize:" && meminfo >> size)
+      return size << 10;
+    meminfo.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  }
+  return 0;
+}
+
+// size of transparent huge pages, 0 if unknown
+static std::size_t
+get_huge_page_size_transparent()
+{
+  std::ifstream pmd_size("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size");
+  std::size_t size;
+  if (pmd_size >> size)
+    return size;
+  return get_huge_page_size_explicit();
+}
+
+HugePages
+get_huge_pages(const std::string &name)
+{
+  if (name == "none")
+    return HugePages::NONE;
+  if (name == "transparent")
+    return HugePages::TRANSPARENT;
+  if (name == "explicit")
+    return HugePages::EXPLICIT;
+  throw std::runtime_error("invalid huge page mode: \"" + name + "\"");
+}
+
+FrameMemory::FrameMemory(const std::size_t size, const HugePages huge_pages, const bool lock)
+    : length(size)
+{
+  if (!size)
+    return;
+
+  // the length of explicit huge page mappings must be a multiple of the huge page size
+  std::size_t page_size = sysconf(_SC_PAGESIZE);
+  if (huge_pages == HugePages::EXPLICIT) {
+    static const std::size_t huge_page_size = get_huge_page_size_explicit();
+    if (!huge_page_size)
+      throw std::runtime_error("explicit huge pages not supported by the kernel");
+    page_size = huge_page_size;
+  }
+  else if (huge_pages == HugePages::TRANSPARENT) {
+    // without a known size, the advice applies to the mapping with regular page alignment
+    static const std::size_t huge_page_size = get_huge_page_size_transparent();
+    page_size = std::max(page_size, huge_page_size);
+  }
+  length_mapped = (size + page_size - 1) / page_size * page_size;
+
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  if (huge_pages == HugePages::EXPLICIT)
+    flags |= MAP_HUGETLB | MAP_POPULATE;
+  void *p = mmap(nullptr, length_mapped, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (p == MAP_FAILED)
+    throw std::runtime_error("failed to allocate " + std::to_string(length_mapped) +
+                             " bytes of frame memory in pages of " + std::to_string(page_size) +
+                             " bytes: " + std::string(std::strerror(errno)));
+  ptr = static_cast<uint8_t *>(p);
+
+  // request transparent huge pages before the memory is faulted in
+  if (huge_pages == HugePages::TRANSPARENT && madvise(ptr, length_mapped, MADV_HUGEPAGE)) {
+    const int err = errno;
+    munmap(ptr, length_mapped);
+    ptr = nullptr;
+    throw std::runtime_error("transparent huge pages not supported: " +
+                             std::string(std::strerror(err)));
+  }
+
+  // locking faults in the memory, otherwise touch every page
+  if (lock) {
+    if (mlock(ptr, length_mapped)) {
+      const int err = errno;
+      munmap(ptr, length_mapped);
+      ptr = nullptr;
+      throw std::runtime_error("failed to lock frame memory: " + std::string(std::strerror(err)));
+    }
+  }
+  else if (huge_pages != HugePages::EXPLICIT) {
+    std::memset(ptr, 0, length_mapped);
+  }
+}
+
+FrameMemory::~FrameMemory()
+{
+  if (ptr)
+    munmap(ptr, length_mapped);
+}
+
+FrameMemory::FrameMemory(FrameMemory &&other) noexcept
+    : ptr(std::exchange(other.ptr, nullptr)), length(std::exchange(other.length, 0)),
+      length_mapped(std::exchange(other.length_mapped, 0))
+{}
+
+FrameMemory &
+FrameMemory::operator=(FrameMemory &&other) noexcept
+{
+  std::swap(ptr, other.ptr);
+  std::swap(length, other.length);
+  std::swap(length_mapped, other.length_mapped);
+  return *this;
+}
+
+uint8_t *
+FrameMemory::data() const
+{
+  return ptr;
+}
+
+std::size_t
+FrameMemory::size() const
+{
+  return length;
+}
+
+void
+retain_heap_memory()
+{
+  // allocate large buffers from the heap instead of separate mappings, and never trim it
+  mallopt(M_MMAP_THRESHOLD, 32 << 20);
+  mallopt(M_TRIM_THRESHOLD, INT_MAX);
+  mallopt(M_TOP_PAD, 64 << 20);
+}
+
+void
+lock_memory()
+{
+  if (mlockall(MCL_CURRENT | MCL_FUTURE))
+    throw std::runtime_error("failed to lock memory: " + std::string(std::strerror(errno)));
+}
+
+MemoryCounters::MemoryCounters()
+{
+  perf_event_attr attr = {};
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  // counters are not available in all kernels, virtual machines or with 'perf_event_paranoid'
+  fd_tlb = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+MemoryCounters::~MemoryCounters()
+{
+  if (fd_tlb >= 0)
+    close(fd_tlb);
+}
+
+MemoryCounts
+MemoryCounters::read() const
+{
+  MemoryCounts counts = {};
+
+  rusage usage;
+  if (!getrusage(RUSAGE_THREAD, &usage)) {
+    counts.minor_faults = usage.ru_minflt;
+    counts.major_faults = usage.ru_majflt;
+  }
+
+  uint64_t tlb_misses;
+  if (fd_tlb >= 0 && ::read(fd_tlb, &tlb_misses, sizeof(tlb_misses)) == sizeof(tlb_misses))
+    counts.tlb_misses = tlb_misses;
+  else
+    counts.tlb_misses = -1;
+
+  return counts;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+enum class HugePages
+{
+  NONE,
+  TRANSPARENT,
+  EXPLICIT,
+};
+
+// huge page mode by name, one of {none, transparent, explicit}
+HugePages
+get_huge_pages(const std::string &name);
+
+// Anonymous memory for frame buffers, optionally backed by huge pages and locked in RAM.
+// The memory is faulted in on allocation, so that writing frames does not page fault.
+// Explicit huge pages have to be reserved via 'vm.nr_hugepages'.
+class FrameMemory
+{
+public:
+  FrameMemory() = default;
+
+  FrameMemory(const std::size_t size, const HugePages huge_pages, const bool lock);
+
+  ~FrameMemory();
+
+  FrameMemory(FrameMemory &&other) noexcept;
+
+  FrameMemory &
+  operator=(FrameMemory &&other) noexcept;
+
+  uint8_t *
+  data() const;
+
+  std::size_t
+  size() const;
+
+private:
+  uint8_t *ptr = nullptr;
+  std::size_t length = 0;
+  std::size_t length_mapped = 0;
+};
+
+// keep freed heap memory in the process instead of returning it to the system,
+// such that the message buffers of a frame reuse the pages of previous frames
+void
+retain_heap_memory();
+
+// lock the current and future memory of the process in RAM
+void
+lock_memory();
+
+struct MemoryCounts
+{
+  uint64_t minor_faults;
+  uint64_t major_faults;
+  // data TLB misses, -1 if performance counters are not available
+  int64_t tlb_misses;
+};
+
+// Page faults and TLB misses of the thread that created the counters.
+class MemoryCounters
+{
+public:
+  MemoryCounters();
+
+  ~MemoryCounters();
+
+  MemoryCounters(const MemoryCounters &) = delete;
+
+  MemoryCounters &
+  operator=(const MemoryCounters &) = delete;
+
+  MemoryCounts
+  read() const;
+
+private:
+  int fd_tlb = -1;
+};
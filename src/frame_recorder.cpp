@@ -0,0 +1,255 @@
+#include "frame_recorder.hpp"
+#include "frame_copy.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+
+
+static std::size_t
+align(const std::size_t size)
+{
+  return (size + frame_file_alignment - 1) / frame_file_alignment * frame_file_alignment;
+}
+
+static void
+write_all(const int fd, const void *data, const std::size_t size)
+{
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  std::size_t written = 0;
+  while (written < size) {
+    const ssize_t n = ::write(fd, p + written, size - written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      throw std::runtime_error(std::string("failed to write frame index: ") +
+                               std::strerror(errno));
+    written += n;
+  }
+}
+
+FrameRecorder::FrameRecorder(const std::string &prefix, const uint64_t segment_size,
+                             const std::size_t frame_size_max, const std::size_t slots,
+                             const HugePages huge_pages, const bool lock)
+    : prefix(prefix), segment_size(segment_size), slot_size(align(frame_size_max)),
+      entries(slots)
+{
+  if (!slots || !frame_size_max)
+    throw std::runtime_error("recorder requires at least one staging slot");
+  if (slot_size > segment_size)
+    throw std::runtime_error("segment size smaller than a frame");
+
+  // page-aligned for direct I/O
+  staging = FrameMemory(slots * slot_size, huge_pages, lock);
+  batch.reserve(slots);
+  batch_entries.reserve(slots);
+
+  open_segment();
+  t_start = std::chrono::steady_clock::now();
+  writer = std::thread(&FrameRecorder::run, this);
+}
+
+FrameRecorder::~FrameRecorder()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stop = true;
+  }
+  queued.notify_one();
+  writer.join();
+  close_segment();
+}
+
+bool
+FrameRecorder::push(const FrameIndexEntry &entry, const uint8_t *data)
+{
+  std::unique_lock<std::mutex> guard(lock);
+  if (count == entries.size() || entry.size > slot_size || !stats.error.empty()) {
+    stats.dropped++;
+    return false;
+  }
+  const std::size_t slot = (first + count) % entries.size();
+  guard.unlock();
+
+  // the slot is not accessed by the writer until it is queued
+  uint8_t *dst = staging.data() + slot * slot_size;
+  copy_frame(dst, data, entry.size);
+  std::memset(dst + entry.size, 0, align(entry.size) - entry.size);
+  entries[slot] = entry;
+
+  guard.lock();
+  count++;
+  guard.unlock();
+  queued.notify_one();
+  return true;
+}
+
+FrameRecorder::Statistics
+FrameRecorder::statistics() const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  Statistics s = stats;
+  s.time_total =
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+  return s;
+}
+
+void
+FrameRecorder::open_segment()
+{
+  char suffix[16];
+  std::snprintf(suffix, sizeof(suffix), "_%04lu", (unsigned long)stats.segments);
+  const std::string path = prefix + suffix;
+
+  // bypass the page cache, if supported by the file system
+  bool direct = true;
+  fd_data = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+  if (fd_data < 0 && errno == EINVAL) {
+    direct = false;
+    fd_data = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  }
+  if (fd_data < 0)
+    throw std::runtime_error("failed to open \"" + path + "\": " + std::strerror(errno));
+
+  // reserve the segment to avoid block allocation and fragmentation while recording
+  if (fallocate(fd_data, 0, 0, segment_size) && errno != EOPNOTSUPP) {
+    const int err = errno;
+    ::close(fd_data);
+    fd_data = -1;
+    throw std::runtime_error("failed to preallocate \"" + path + "\": " + std::strerror(err));
+  }
+
+  const std::string path_index = path + ".index";
+  fd_index = ::open(path_index.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_index < 0) {
+    const int err = errno;
+    ::close(fd_data);
+    fd_data = -1;
+    throw std::runtime_error("failed to open \"" + path_index + "\": " + std::strerror(err));
+  }
+  const FrameIndexHeader header = make_frame_index_header();
+  write_all(fd_index, &header, sizeof(header));
+
+  offset = 0;
+
+  std::lock_guard<std::mutex> guard(lock);
+  stats.direct = direct;
+  stats.segments++;
+}
+
+void
+FrameRecorder::close_segment()
+{
+  // descriptors are invalid after a failed 'open_segment'
+  if (fd_data >= 0) {
+    // release the unused preallocated space
+    if (ftruncate(fd_data, offset) || fdatasync(fd_data)) {
+      // keep the preallocated size
+    }
+    ::close(fd_data);
+    fd_data = -1;
+  }
+  if (fd_index >= 0) {
+    ::close(fd_index);
+    fd_index = -1;
+  }
+}
+
+void
+FrameRecorder::write_batch()
+{
+  // write consecutive slots to consecutive file offsets, resuming after partial writes
+  const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  uint64_t size = 0;
+  for (const iovec &v : batch)
+    size += v.iov_len;
+
+  std::size_t i = 0;
+  uint64_t written = 0;
+  while (i < batch.size()) {
+    const int iovcnt = std::min<std::size_t>(batch.size() - i, IOV_MAX);
+    const ssize_t n = pwritev(fd_data, batch.data() + i, iovcnt, offset + written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      throw std::runtime_error(std::string("failed to write frames: ") + std::strerror(errno));
+    written += n;
+    for (std::size_t remaining = n; remaining;) {
+      const std::size_t step = std::min(remaining, batch[i].iov_len);
+      batch[i].iov_base = static_cast<uint8_t *>(batch[i].iov_base) + step;
+      batch[i].iov_len -= step;
+      remaining -= step;
+      if (!batch[i].iov_len)
+        i++;
+    }
+  }
+  offset += size;
+
+  write_all(fd_index, batch_entries.data(), batch_entries.size() * sizeof(FrameIndexEntry));
+
+  const double time =
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  std::lock_guard<std::mutex> guard(lock);
+  stats.frames += batch_entries.size();
+  stats.bytes += size;
+  stats.time_write += time;
+}
+
+void
+FrameRecorder::run()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    queued.wait(guard, [this] { return stop || count; });
+    if (!count)
+      break;
+
+    // consecutive slots up to the end of the staging buffer
+    const std::size_t begin = first;
+    const std::size_t n = std::min(count, entries.size() - first);
+    guard.unlock();
+
+    // frames of this run that are written before a segment switch
+    std::size_t written = 0;
+    try {
+      batch.clear();
+      batch_entries.clear();
+      uint64_t end = offset;
+      for (std::size_t slot = begin; slot < begin + n; slot++) {
+        const std::size_t size = align(entries[slot].size);
+        if (end + size > segment_size) {
+          // continue in a new segment
+          write_batch();
+          written += batch_entries.size();
+          batch.clear();
+          batch_entries.clear();
+          close_segment();
+          open_segment();
+          end = 0;
+        }
+        batch.push_back({staging.data() + slot * slot_size, size});
+        batch_entries.push_back(entries[slot]);
+        batch_entries.back().offset = end;
+        end += size;
+      }
+      write_batch();
+    }
+    catch (const std::runtime_error &e) {
+      // drop the unwritten and all queued frames, 'push' rejects further frames
+      guard.lock();
+      stats.error = e.what();
+      stats.dropped += count - written;
+      first = (first + count) % entries.size();
+      count = 0;
+      continue;
+    }
+
+    guard.lock();
+    first = (first + n) % entries.size();
+    count -= n;
+  }
+}
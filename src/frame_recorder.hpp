@@ -0,0 +1,96 @@
+#pragma once
+#include "frame_file.hpp"
+#include "frame_memory.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <sys/uio.h>
+#include <vector>
+
+
+// Record frames to preallocated segment files with direct I/O.
+//
+// Frames are copied into a fixed number of page-aligned staging slots and written by a
+// separate thread in batches of consecutive slots with a single vectored write, bypassing the
+// page cache. The payload is written in the frame file layout with an index per segment.
+// A new segment "<prefix>_<n>" is started when a segment reaches its preallocated size.
+class FrameRecorder
+{
+public:
+  FrameRecorder(const std::string &prefix, const uint64_t segment_size,
+                const std::size_t frame_size_max, const std::size_t slots,
+                const HugePages huge_pages = HugePages::NONE, const bool lock = false);
+
+  ~FrameRecorder();
+
+  FrameRecorder(const FrameRecorder &) = delete;
+
+  FrameRecorder &
+  operator=(const FrameRecorder &) = delete;
+
+  // copy a frame into a free staging slot, false if all slots are in use
+  bool
+  push(const FrameIndexEntry &entry, const uint8_t *data);
+
+  struct Statistics
+  {
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t dropped;
+    uint64_t segments;
+    // time (s) spent in writes, and since the start of the recording
+    double time_write;
+    double time_total;
+    // direct I/O is not supported by all file systems
+    bool direct;
+    // write error that stopped the recording
+    std::string error;
+  };
+
+  Statistics
+  statistics() const;
+
+private:
+  const std::string prefix;
+  const uint64_t segment_size;
+  const std::size_t slot_size;
+
+  // staging slots used as a circular queue
+  FrameMemory staging;
+  std::vector<FrameIndexEntry> entries;
+  std::size_t first = 0;
+  std::size_t count = 0;
+
+  mutable std::mutex lock;
+  std::condition_variable queued;
+  bool stop = false;
+  Statistics stats = {};
+  std::chrono::steady_clock::time_point t_start;
+
+  // current segment
+  int fd_data = -1;
+  int fd_index = -1;
+  uint64_t offset = 0;
+
+  // batch of slots and their index entries in the writer thread
+  std::vector<iovec> batch;
+  std::vector<FrameIndexEntry> batch_entries;
+
+  std::thread writer;
+
+  void
+  open_segment();
+
+  void
+  close_segment();
+
+  void
+  write_batch();
+
+  void
+  run();
+};
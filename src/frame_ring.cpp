@@ -0,0 +1,125 @@
+#include "frame_ring.hpp"
+#include "frame_copy.hpp"
+#include <cstring>
+
+
+FrameRing::FrameRing(const std::size_t capacity, const std::size_t frames_max,
+                     const HugePages huge_pages, const bool lock)
+    : storage(capacity, huge_pages, lock), entries(frames_max)
+{}
+
+const FrameIndexEntry &
+FrameRing::at(const std::size_t i) const
+{
+  return entries[(first + i) % entries.size()];
+}
+
+void
+FrameRing::pop()
+{
+  used -= entries[first].size;
+  first = (first + 1) % entries.size();
+  count--;
+  popped++;
+  if (!count)
+    end = 0;
+}
+
+bool
+FrameRing::push(const FrameIndexEntry &entry, const uint8_t *data)
+{
+  if (entry.size > storage.size() || entries.empty())
+    return false;
+
+  // reserve the space under the lock and copy outside of it, readers only access stored frames
+  std::unique_lock<std::mutex> guard(lock);
+
+  if (count == entries.size())
+    pop();
+
+  // place the payload after the newest frame, or wrap around to the start of the storage
+  std::size_t offset = end;
+  if (offset + entry.size > storage.size()) {
+    // evict the oldest frames behind the newest frame
+    while (count && entries[first].offset >= end)
+      pop();
+    offset = 0;
+  }
+
+  // evict the oldest frames that overlap the new payload
+  while (count && entries[first].offset < offset + entry.size &&
+         offset < entries[first].offset + entries[first].size)
+    pop();
+
+  end = offset + entry.size;
+  guard.unlock();
+
+  copy_frame(storage.data() + offset, data, entry.size);
+
+  guard.lock();
+  FrameIndexEntry &stored = entries[(first + count) % entries.size()];
+  stored = entry;
+  stored.offset = offset;
+  count++;
+  used += entry.size;
+  guard.unlock();
+
+  pushed.notify_all();
+  return true;
+}
+
+bool
+FrameRing::read(const uint64_t sequence, FrameIndexEntry &entry, std::vector<uint8_t> &data) const
+{
+  std::unique_lock<std::mutex> guard(lock);
+
+  while (true) {
+    // position of the frame in the sequence of all stored frames
+    std::size_t i = 0;
+    while (i < count && at(i).sequence < sequence)
+      i++;
+    if (i == count)
+      return false;
+    entry = at(i);
+    const uint64_t position = popped + i;
+
+    // copy outside of the lock, the payload is only overwritten after the frame was evicted
+    guard.unlock();
+    data.resize(entry.size);
+    std::memcpy(data.data(), storage.data() + entry.offset, entry.size);
+    guard.lock();
+
+    // retry with the next frame if this one was evicted while copying
+    if (position >= popped)
+      return true;
+  }
+}
+
+bool
+FrameRing::wait(const uint64_t sequence, const std::chrono::milliseconds timeout) const
+{
+  std::unique_lock<std::mutex> guard(lock);
+  return pushed.wait_for(guard, timeout,
+                         [&] { return count && at(count - 1).sequence >= sequence; });
+}
+
+std::size_t
+FrameRing::frames() const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return count;
+}
+
+std::size_t
+FrameRing::bytes() const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return used;
+}
+
+int64_t
+FrameRing::duration() const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return count ? at(count - 1).timestamp - at(0).timestamp : 0;
+}
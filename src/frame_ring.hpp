@@ -0,0 +1,69 @@
+#pragma once
+#include "frame_file.hpp"
+#include "frame_memory.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+
+// Bounded ring of the most recent frames in a preallocated buffer.
+//
+// The payload of every frame is stored contiguously, and the oldest frames are evicted to make
+// space for a new frame. Storing a frame copies its payload without allocating memory.
+// Payloads are copied outside of the lock: a single thread stores frames, and readers detect
+// frames that were evicted while copying and retry.
+class FrameRing
+{
+public:
+  FrameRing(const std::size_t capacity, const std::size_t frames_max,
+            const HugePages huge_pages = HugePages::NONE, const bool lock = false);
+
+  // store a frame with 'entry.size' bytes of payload, false if it exceeds the capacity,
+  // only called from a single thread
+  bool
+  push(const FrameIndexEntry &entry, const uint8_t *data);
+
+  // copy the oldest frame with a sequence number of at least 'sequence',
+  // false if there is no such frame
+  bool
+  read(const uint64_t sequence, FrameIndexEntry &entry, std::vector<uint8_t> &data) const;
+
+  // wait until a frame with a sequence number of at least 'sequence' is stored
+  bool
+  wait(const uint64_t sequence, const std::chrono::milliseconds timeout) const;
+
+  // number of stored frames and payload bytes
+  std::size_t
+  frames() const;
+
+  std::size_t
+  bytes() const;
+
+  // time span (ns) between the oldest and newest frame
+  int64_t
+  duration() const;
+
+private:
+  mutable std::mutex lock;
+  mutable std::condition_variable pushed;
+
+  FrameMemory storage;
+  // circular queue of stored frames, with their offset in the storage
+  std::vector<FrameIndexEntry> entries;
+  std::size_t first = 0;
+  std::size_t count = 0;
+  // offset after the payload of the newest frame
+  std::size_t end = 0;
+  std::size_t used = 0;
+  // number of evicted frames
+  uint64_t popped = 0;
+
+  const FrameIndexEntry &
+  at(const std::size_t i) const;
+
+  void
+  pop();
+};
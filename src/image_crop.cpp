@@ -0,0 +1,42 @@
+#include "image_crop.hpp"
+#include <algorithm>
+#include <cstring>
+#include <sensor_msgs/image_encodings.hpp>
+
+
+bool
+crop_image(const ImageView &src, const sensor_msgs::msg::RegionOfInterest &roi,
+           sensor_msgs::msg::Image &dst)
+{
+  namespace enc = sensor_msgs::image_encodings;
+
+  const bool yuv422 = src.encoding == enc::YUV422 || src.encoding == enc::YUV422_YUY2;
+  const uint32_t pixel_size =
+    yuv422 ? 2 : enc::numChannels(src.encoding) * enc::bitDepth(src.encoding) / 8;
+  const uint32_t align_x = (yuv422 || enc::isBayer(src.encoding)) ? 2 : 1;
+  const uint32_t align_y = enc::isBayer(src.encoding) ? 2 : 1;
+
+  const uint32_t x = std::min(roi.x_offset, src.width) / align_x * align_x;
+  const uint32_t y = std::min(roi.y_offset, src.height) / align_y * align_y;
+  // an empty region selects the full image, as in 'sensor_msgs/CameraInfo'
+  const uint32_t x_end = roi.width ? std::min(roi.x_offset + roi.width, src.width) : src.width;
+  const uint32_t y_end = roi.height ? std::min(roi.y_offset + roi.height, src.height) : src.height;
+  const uint32_t width = x_end > x ? (x_end - x) / align_x * align_x : 0;
+  const uint32_t height = y_end > y ? (y_end - y) / align_y * align_y : 0;
+  if (!width || !height)
+    return false;
+
+  dst.width = width;
+  dst.height = height;
+  dst.encoding = src.encoding;
+  dst.is_bigendian = (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__);
+  dst.step = width * pixel_size;
+  dst.data.resize(std::size_t(dst.step) * height);
+
+  const uint8_t *s = src.data + std::size_t(y) * src.step + std::size_t(x) * pixel_size;
+  for (uint32_t row = 0; row < height; row++)
+    std::memcpy(dst.data.data() + std::size_t(row) * dst.step, s + std::size_t(row) * src.step,
+                dst.step);
+
+  return true;
+}
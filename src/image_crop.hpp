@@ -0,0 +1,11 @@
+#pragma once
+#include "image_view.hpp"
+#include <sensor_msgs/msg/image.hpp>
+#include <sensor_msgs/msg/region_of_interest.hpp>
+
+// Copy a region of an uncompressed image row by row, with the source row stride.
+// The region is clipped to the image and aligned down to whole 2x2 cells for Bayer patterns
+// and to pixel pairs for packed 4:2:2 formats. Returns false if the clipped region is empty.
+bool
+crop_image(const ImageView &src, const sensor_msgs::msg::RegionOfInterest &roi,
+           sensor_msgs::msg::Image &dst);
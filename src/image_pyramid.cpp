@@ -0,0 +1,188 @@
+#include "image_pyramid.hpp"
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <sensor_msgs/image_encodings.hpp>
+#include <stdexcept>
+#include <vector>
+
+
+namespace enc = sensor_msgs::image_encodings;
+
+// reduce two source rows to one row of 'width' pixels
+typedef void (*row_kernel_t)(const uint8_t *r0, const uint8_t *r1, uint8_t *dst,
+                             const uint32_t width);
+
+// 2x2 box filter of 'C' interleaved channels
+template<typename T, int C>
+static void
+box_row(const uint8_t *r0, const uint8_t *r1, uint8_t *dst, const uint32_t width)
+{
+  const T *a = reinterpret_cast<const T *>(r0);
+  const T *b = reinterpret_cast<const T *>(r1);
+  T *d = reinterpret_cast<T *>(dst);
+  for (uint32_t x = 0; x < width; x++)
+    for (int c = 0; c < C; c++)
+      d[x * C + c] = (uint32_t(a[2 * x * C + c]) + a[(2 * x + 1) * C + c] + b[2 * x * C + c] +
+                      b[(2 * x + 1) * C + c] + 2) >>
+                     2;
+}
+
+// packed 4:2:2 with the byte offsets of both luma and chroma samples of a pixel pair
+template<int Y0, int U, int Y1, int V>
+static void
+yuv422_row(const uint8_t *r0, const uint8_t *r1, uint8_t *dst, const uint32_t width)
+{
+  for (uint32_t x = 0; x + 1 < width; x += 2) {
+    // two source pairs per row for every destination pair
+    const uint8_t *a = r0 + 4 * x;
+    const uint8_t *b = r1 + 4 * x;
+    uint8_t *d = dst + 2 * x;
+    d[Y0] = (a[Y0] + a[Y1] + b[Y0] + b[Y1] + 2) >> 2;
+    d[Y1] = (a[4 + Y0] + a[4 + Y1] + b[4 + Y0] + b[4 + Y1] + 2) >> 2;
+    d[U] = (a[U] + a[4 + U] + b[U] + b[4 + U] + 2) >> 2;
+    d[V] = (a[V] + a[4 + V] + b[V] + b[4 + V] + 2) >> 2;
+  }
+}
+
+// 2x2 Bayer cell to RGB, with red at column 'RX' and row 'RY' and blue diagonal to it
+template<typename T, int RX, int RY>
+static void
+bayer_row(const uint8_t *r0, const uint8_t *r1, uint8_t *dst, const uint32_t width)
+{
+  const T *rows[2] = {reinterpret_cast<const T *>(r0), reinterpret_cast<const T *>(r1)};
+  const T *red = rows[RY] + RX;
+  const T *blue = rows[1 - RY] + (1 - RX);
+  const T *green0 = rows[RY] + (1 - RX);
+  const T *green1 = rows[1 - RY] + RX;
+  T *d = reinterpret_cast<T *>(dst);
+  for (uint32_t x = 0; x < width; x++) {
+    d[3 * x + 0] = red[2 * x];
+    d[3 * x + 1] = (uint32_t(green0[2 * x]) + green1[2 * x] + 1) >> 1;
+    d[3 * x + 2] = blue[2 * x];
+  }
+}
+
+static row_kernel_t
+get_row_kernel(const std::string &encoding)
+{
+  if (encoding == enc::MONO8)
+    return box_row<uint8_t, 1>;
+  if (encoding == enc::RGB8 || encoding == enc::BGR8)
+    return box_row<uint8_t, 3>;
+  if (encoding == enc::RGBA8 || encoding == enc::BGRA8)
+    return box_row<uint8_t, 4>;
+  if (encoding == enc::RGB16)
+    return box_row<uint16_t, 3>;
+  if (encoding == enc::YUV422)
+    return yuv422_row<1, 0, 3, 2>;
+  if (encoding == enc::YUV422_YUY2)
+    return yuv422_row<0, 1, 2, 3>;
+  if (encoding == enc::BAYER_RGGB8)
+    return bayer_row<uint8_t, 0, 0>;
+  if (encoding == enc::BAYER_GRBG8)
+    return bayer_row<uint8_t, 1, 0>;
+  if (encoding == enc::BAYER_GBRG8)
+    return bayer_row<uint8_t, 0, 1>;
+  if (encoding == enc::BAYER_BGGR8)
+    return bayer_row<uint8_t, 1, 1>;
+  if (encoding == enc::BAYER_RGGB16)
+    return bayer_row<uint16_t, 0, 0>;
+  if (encoding == enc::BAYER_GRBG16)
+    return bayer_row<uint16_t, 1, 0>;
+  if (encoding == enc::BAYER_GBRG16)
+    return bayer_row<uint16_t, 0, 1>;
+  if (encoding == enc::BAYER_BGGR16)
+    return bayer_row<uint16_t, 1, 1>;
+  return nullptr;
+}
+
+std::string
+pyramid_encoding(const std::string &encoding)
+{
+  if (!get_row_kernel(encoding))
+    return {};
+  if (enc::isBayer(encoding))
+    return enc::bitDepth(encoding) > 8 ? enc::RGB16 : enc::RGB8;
+  return encoding;
+}
+
+static bool
+is_yuv422(const std::string &encoding)
+{
+  return encoding == enc::YUV422 || encoding == enc::YUV422_YUY2;
+}
+
+static uint32_t
+row_size(const uint32_t width, const std::string &encoding)
+{
+  if (is_yuv422(encoding))
+    return width * 2;
+  return width * enc::numChannels(encoding) * enc::bitDepth(encoding) / 8;
+}
+
+// allocate an image of the reduced size
+static void
+set_image(sensor_msgs::msg::Image &image, const uint32_t width, const uint32_t height,
+          const std::string &encoding)
+{
+  image.width = width;
+  image.height = height;
+  image.encoding = encoding;
+  image.is_bigendian = (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__);
+  image.step = row_size(width, encoding);
+  image.data.resize(std::size_t(image.step) * height);
+}
+
+void
+downscale_pyramid(const ImageView &src, sensor_msgs::msg::Image *half,
+                  sensor_msgs::msg::Image *quarter, WorkerPool &pool)
+{
+  const std::string encoding = pyramid_encoding(src.encoding);
+  if (encoding.empty())
+    throw std::runtime_error("unsupported pyramid encoding: " + src.encoding);
+  const row_kernel_t kernel_src = get_row_kernel(src.encoding);
+  const row_kernel_t kernel_half = get_row_kernel(encoding);
+
+  // packed 4:2:2 images have whole pixel pairs
+  const uint32_t align = is_yuv422(encoding) ? 2 : 1;
+  const uint32_t width_half = (src.width / 2) / align * align;
+  const uint32_t height_half = src.height / 2;
+  const uint32_t width_quarter = (width_half / 2) / align * align;
+  const uint32_t height_quarter = height_half / 2;
+
+  // half rows are computed in a scratch buffer if only the quarter image is requested
+  const uint32_t step_half = row_size(width_half, encoding);
+  if (half)
+    set_image(*half, width_half, height_half, encoding);
+  if (quarter)
+    set_image(*quarter, width_quarter, height_quarter, encoding);
+  if (!half && !quarter)
+    return;
+
+  // bands of pairs of half rows, two bands per thread for load balancing
+  const uint32_t pairs = (height_half + 1) / 2;
+  const uint32_t bands_max = 2 * (pool.size() + 1);
+  const uint32_t band_pairs = std::max<uint32_t>((pairs + bands_max - 1) / bands_max, 1);
+  const uint32_t bands = (pairs + band_pairs - 1) / band_pairs;
+
+  pool.parallel_for(bands, [&](const std::size_t band) {
+    thread_local std::vector<uint8_t> scratch;
+    if (!half)
+      scratch.resize(2 * std::size_t(step_half));
+
+    const uint32_t pair_end = std::min<uint32_t>((band + 1) * band_pairs, pairs);
+    for (uint32_t pair = band * band_pairs; pair < pair_end; pair++) {
+      uint8_t *rows_half[2] = {};
+      for (uint32_t i = 0; i < 2 && 2 * pair + i < height_half; i++) {
+        const uint32_t row = 2 * pair + i;
+        rows_half[i] = half ? half->data.data() + std::size_t(row) * step_half
+                            : scratch.data() + i * std::size_t(step_half);
+        const uint8_t *r0 = src.data + std::size_t(2 * row) * src.step;
+        kernel_src(r0, r0 + src.step, rows_half[i], width_half);
+      }
+      if (quarter && pair < height_quarter)
+        kernel_half(rows_half[0], rows_half[1],
+                    quarter->data.data() + std::size_t(pair) * quarter->step, width_quarter);
+    }
+  });
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "image_view.hpp"
+#include <sensor_msgs/msg/image.hpp>
+#include <string>
+
+class WorkerPool;
+
+// Reduced-resolution images at 1/2 and 1/4 of the width and height.
+//
+// Both levels are built in one pass over the source rows: every pair of source rows is
+// reduced to a row of the half image with a 2x2 box filter, and every pair of half rows to a
+// row of the quarter image. Bands of rows are processed on the worker pool.
+//
+// Interleaved 8-bit formats ("mono8", "rgb8", "bgr8", "rgba8", "bgra8") keep their encoding.
+// The packed "yuv422" and "yuv422_yuy2" formats average luma per pixel and chroma over the
+// two pairs of a 4x2 block, with the width truncated to whole pairs. Bayer patterns are binned
+// per 2x2 cell to "rgb8" or "rgb16", averaging the two green samples.
+
+// encoding of the reduced images, empty if the source encoding is not supported
+std::string
+pyramid_encoding(const std::string &encoding);
+
+// fill the requested levels, 'half' or 'quarter' may be null
+void
+downscale_pyramid(const ImageView &src, sensor_msgs::msg::Image *half,
+                  sensor_msgs::msg::Image *quarter, WorkerPool &pool);
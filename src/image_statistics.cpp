@@ -0,0 +1,231 @@
+#include "image_statistics.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <sensor_msgs/image_encodings.hpp>
+#include <stdexcept>
+
+
+namespace enc = sensor_msgs::image_encodings;
+
+// BT.601 luma weights in 8-bit fixed point
+static inline uint32_t
+luma_rgb(const uint32_t r, const uint32_t g, const uint32_t b)
+{
+  return (77 * r + 150 * g + 29 * b) >> 8;
+}
+
+// interleaved channels with the byte offsets of red, green and blue, or a single channel
+template<int C, int R, int G, int B>
+struct interleaved_t
+{
+  static constexpr int channels = C == 1 ? 1 : 3;
+  static constexpr uint32_t max = 255;
+
+  const ImageView &image;
+
+  uint32_t
+  width() const
+  {
+    return image.width;
+  }
+
+  uint32_t
+  height() const
+  {
+    return image.height;
+  }
+
+  uint32_t
+  read(const uint32_t x, const uint32_t y, uint32_t c[3]) const
+  {
+    const uint8_t *p = image.data + std::size_t(y) * image.step + std::size_t(x) * C;
+    if (C == 1) {
+      c[0] = p[0];
+      return c[0];
+    }
+    c[0] = p[R];
+    c[1] = p[G];
+    c[2] = p[B];
+    return luma_rgb(c[0], c[1], c[2]);
+  }
+};
+
+// packed 4:2:2 with the byte offsets in a pixel pair
+template<int Y0, int U, int Y1, int V>
+struct yuv422_t
+{
+  static constexpr int channels = 3;
+  static constexpr uint32_t max = 255;
+
+  const ImageView &image;
+
+  uint32_t
+  width() const
+  {
+    return image.width;
+  }
+
+  uint32_t
+  height() const
+  {
+    return image.height;
+  }
+
+  uint32_t
+  read(const uint32_t x, const uint32_t y, uint32_t c[3]) const
+  {
+    const uint8_t *p = image.data + std::size_t(y) * image.step + std::size_t(x / 2) * 4;
+    c[0] = p[(x % 2) ? Y1 : Y0];
+    c[1] = p[U];
+    c[2] = p[V];
+    return c[0];
+  }
+};
+
+// 2x2 Bayer cells, with red at column 'RX' and row 'RY'
+template<typename T, int RX, int RY>
+struct bayer_t
+{
+  static constexpr int channels = 3;
+  static constexpr uint32_t max = (1u << (8 * sizeof(T))) - 1;
+
+  const ImageView &image;
+
+  uint32_t
+  width() const
+  {
+    return image.width / 2;
+  }
+
+  uint32_t
+  height() const
+  {
+    return image.height / 2;
+  }
+
+  uint32_t
+  read(const uint32_t x, const uint32_t y, uint32_t c[3]) const
+  {
+    const uint8_t *r0 = image.data + std::size_t(2 * y) * image.step;
+    const T *rows[2] = {reinterpret_cast<const T *>(r0),
+                        reinterpret_cast<const T *>(r0 + image.step)};
+    c[0] = rows[RY][2 * x + RX];
+    c[1] = (uint32_t(rows[RY][2 * x + 1 - RX]) + rows[1 - RY][2 * x + RX] + 1) / 2;
+    c[2] = rows[1 - RY][2 * x + 1 - RX];
+    return luma_rgb(c[0], c[1], c[2]);
+  }
+};
+
+template<typename Reader>
+static void
+accumulate(const Reader &reader, const uint32_t grid, ImageStatistics &statistics)
+{
+  // 256 histogram bins over the full range
+  constexpr uint32_t shift = Reader::max > 255 ? 8 : 0;
+
+  uint64_t sums[3] = {};
+  uint64_t gradients = 0;
+  uint32_t samples = 0;
+  uint32_t c[3], n[3];
+
+  // the last row and column are neighbours only
+  const uint32_t width = reader.width();
+  const uint32_t height = reader.height();
+  for (uint32_t y = 0; y + 1 < height; y += grid) {
+    for (uint32_t x = 0; x + 1 < width; x += grid) {
+      const uint32_t luma = reader.read(x, y, c);
+      const uint32_t luma_right = reader.read(x + 1, y, n);
+      const uint32_t luma_below = reader.read(x, y + 1, n);
+
+      statistics.histogram[luma >> shift]++;
+      bool low = false, high = false;
+      for (int i = 0; i < Reader::channels; i++) {
+        sums[i] += c[i];
+        low |= c[i] == 0;
+        high |= c[i] >= Reader::max;
+      }
+      statistics.clipped_low += low;
+      statistics.clipped_high += high;
+      gradients += std::abs(int32_t(luma_right) - int32_t(luma)) +
+                   std::abs(int32_t(luma_below) - int32_t(luma));
+      samples++;
+    }
+  }
+
+  statistics.samples = samples;
+  if (!samples)
+    return;
+  for (int i = 0; i < Reader::channels; i++)
+    statistics.means[i] = double(sums[i]) / samples / Reader::max;
+  statistics.sharpness = double(gradients) / (2 * samples) / Reader::max;
+}
+
+template<template<int, int, int, int> class Reader, int A, int B, int C, int D>
+static void
+accumulate(const ImageView &image, const uint32_t grid, ImageStatistics &statistics)
+{
+  accumulate(Reader<A, B, C, D> {image}, grid, statistics);
+}
+
+template<typename T, int RX, int RY>
+static void
+accumulate_bayer(const ImageView &image, const uint32_t grid, ImageStatistics &statistics)
+{
+  accumulate(bayer_t<T, RX, RY> {image}, grid, statistics);
+}
+
+bool
+statistics_supported(const std::string &encoding)
+{
+  return encoding == enc::MONO8 || encoding == enc::RGB8 || encoding == enc::BGR8 ||
+         encoding == enc::RGBA8 || encoding == enc::BGRA8 || encoding == enc::YUV422 ||
+         encoding == enc::YUV422_YUY2 || enc::isBayer(encoding);
+}
+
+void
+compute_statistics(const ImageView &image, const uint32_t grid, ImageStatistics &statistics)
+{
+  statistics = {};
+  const uint32_t g = std::max<uint32_t>(grid, 1);
+  const std::string &e = image.encoding;
+
+  if (e == enc::MONO8)
+    accumulate<interleaved_t, 1, 0, 0, 0>(image, g, statistics);
+  else if (e == enc::RGB8)
+    accumulate<interleaved_t, 3, 0, 1, 2>(image, g, statistics);
+  else if (e == enc::BGR8)
+    accumulate<interleaved_t, 3, 2, 1, 0>(image, g, statistics);
+  else if (e == enc::RGBA8)
+    accumulate<interleaved_t, 4, 0, 1, 2>(image, g, statistics);
+  else if (e == enc::BGRA8)
+    accumulate<interleaved_t, 4, 2, 1, 0>(image, g, statistics);
+  else if (e == enc::YUV422)
+    accumulate<yuv422_t, 1, 0, 3, 2>(image, g, statistics);
+  else if (e == enc::YUV422_YUY2)
+    accumulate<yuv422_t, 0, 1, 2, 3>(image, g, statistics);
+  else if (e == enc::BAYER_RGGB8)
+    accumulate_bayer<uint8_t, 0, 0>(image, g, statistics);
+  else if (e == enc::BAYER_GRBG8)
+    accumulate_bayer<uint8_t, 1, 0>(image, g, statistics);
+  else if (e == enc::BAYER_GBRG8)
+    accumulate_bayer<uint8_t, 0, 1>(image, g, statistics);
+  else if (e == enc::BAYER_BGGR8)
+    accumulate_bayer<uint8_t, 1, 1>(image, g, statistics);
+  else if (e == enc::BAYER_RGGB16)
+    accumulate_bayer<uint16_t, 0, 0>(image, g, statistics);
+  else if (e == enc::BAYER_GRBG16)
+    accumulate_bayer<uint16_t, 1, 0>(image, g, statistics);
+  else if (e == enc::BAYER_GBRG16)
+    accumulate_bayer<uint16_t, 0, 1>(image, g, statistics);
+  else if (e == enc::BAYER_BGGR16)
+    accumulate_bayer<uint16_t, 1, 1>(image, g, statistics);
+  else
+    throw std::runtime_error("unsupported statistics encoding: " + e);
+
+  if (e == enc::MONO8)
+    statistics.channels = "y";
+  else if (e == enc::YUV422 || e == enc::YUV422_YUY2)
+    statistics.channels = "yuv";
+  else
+    statistics.channels = "rgb";
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "image_view.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+// Statistics of an image sampled on a regular grid. Samples are pixels, or 2x2 cells of Bayer
+// patterns that are combined to RGB with the two green values averaged.
+struct ImageStatistics
+{
+  // number of samples on the grid
+  uint32_t samples;
+  // luma histogram over the full range of the samples
+  std::array<uint32_t, 256> histogram;
+  // channels of the means: "y", "rgb" or "yuv"
+  std::string channels;
+  // mean of each channel normalised to [0, 1]
+  std::array<double, 3> means;
+  // samples with any channel at the minimum or maximum of the range
+  uint32_t clipped_low;
+  uint32_t clipped_high;
+  // mean absolute luma gradient to the right and lower neighbour sample, normalised to [0, 1]
+  double sharpness;
+};
+
+bool
+statistics_supported(const std::string &encoding);
+
+// sample every 'grid'-th pixel (or Bayer cell) in both directions
+void
+compute_statistics(const ImageView &image, const uint32_t grid, ImageStatistics &statistics);
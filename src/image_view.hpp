@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+
+// non-owning view of an uncompressed image in memory
+struct ImageView
+{
+  const uint8_t *data;
+  uint32_t width;
+  uint32_t height;
+  // row length in bytes
+  uint32_t step;
+  // ROS image encoding
+  std::string encoding;
+};
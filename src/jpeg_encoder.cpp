@@ -0,0 +1,235 @@
+#include "jpeg_encoder.hpp"
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <jpeglib.h>
+#include <stdexcept>
+#include <string>
+
+
+// maximum number of MCUs between restart markers
+static constexpr uint32_t restart_interval_max = 0xFFFF;
+
+// JPEG markers
+static constexpr uint8_t SOF0 = 0xC0;
+static constexpr uint8_t RST0 = 0xD0;
+static constexpr uint8_t SOI = 0xD8;
+static constexpr uint8_t EOI = 0xD9;
+static constexpr uint8_t SOS = 0xDA;
+static constexpr uint8_t DRI = 0xDD;
+
+struct error_manager_t
+{
+  jpeg_error_mgr pub;
+  std::jmp_buf jump;
+  char message[JMSG_LENGTH_MAX];
+};
+
+static void
+error_exit(j_common_ptr cinfo)
+{
+  // return control to 'encode_rows' or 'decode_jpeg' instead of terminating the process
+  error_manager_t *err = reinterpret_cast<error_manager_t *>(cinfo->err);
+  cinfo->err->format_message(cinfo, err->message);
+  std::longjmp(err->jump, 1);
+}
+
+struct jpeg_buffer_t
+{
+  unsigned char *data = nullptr;
+  unsigned long size = 0;
+
+  ~jpeg_buffer_t() { std::free(data); }
+};
+
+// encode a range of rows as a standalone JPEG
+static void
+encode_rows(const ImageView &image, const int components, const int quality,
+            const uint32_t row_begin, const uint32_t rows, jpeg_buffer_t &buffer)
+{
+  jpeg_compress_struct cinfo;
+  error_manager_t err;
+  cinfo.err = jpeg_std_error(&err.pub);
+  err.pub.error_exit = error_exit;
+  if (setjmp(err.jump)) {
+    jpeg_destroy_compress(&cinfo);
+    throw std::runtime_error("JPEG encoding failed: " + std::string(err.message));
+  }
+
+  jpeg_create_compress(&cinfo);
+  jpeg_mem_dest(&cinfo, &buffer.data, &buffer.size);
+
+  cinfo.image_width = image.width;
+  cinfo.image_height = rows;
+  cinfo.input_components = components;
+  cinfo.in_color_space = components == 3 ? JCS_RGB : JCS_GRAYSCALE;
+  // default sampling and standard Huffman tables, identical for all strips
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, quality, TRUE);
+
+  jpeg_start_compress(&cinfo, TRUE);
+  while (cinfo.next_scanline < cinfo.image_height) {
+    JSAMPROW row = const_cast<JSAMPROW>(
+      image.data + std::size_t(row_begin + cinfo.next_scanline) * image.step);
+    jpeg_write_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+}
+
+// location of the headers and entropy-coded segment in a JPEG
+struct jpeg_layout_t
+{
+  // offset of the SOF0 marker
+  std::size_t sof;
+  // offset of the SOS marker
+  std::size_t sos;
+  // range of the entropy-coded segment
+  std::size_t scan_begin;
+  std::size_t scan_end;
+};
+
+static jpeg_layout_t
+parse_layout(const jpeg_buffer_t &buffer)
+{
+  const unsigned char *d = buffer.data;
+  if (buffer.size < 4 || d[0] != 0xFF || d[1] != SOI || d[buffer.size - 2] != 0xFF ||
+      d[buffer.size - 1] != EOI)
+    throw std::runtime_error("invalid JPEG stream");
+
+  jpeg_layout_t layout = {};
+  std::size_t i = 2;
+  while (i + 4 <= buffer.size) {
+    if (d[i] != 0xFF)
+      throw std::runtime_error("invalid JPEG marker");
+    const uint8_t marker = d[i + 1];
+    const std::size_t length = (std::size_t(d[i + 2]) << 8) | d[i + 3];
+    if (marker == SOF0)
+      layout.sof = i;
+    if (marker == SOS) {
+      layout.sos = i;
+      layout.scan_begin = i + 2 + length;
+      layout.scan_end = buffer.size - 2;
+      return layout;
+    }
+    i += 2 + length;
+  }
+
+  throw std::runtime_error("JPEG stream without scan");
+}
+
+void
+encode_jpeg(const ImageView &image, const int quality, const std::size_t strips,
+            WorkerPool &pool, std::vector<uint8_t> &data)
+{
+  int components;
+  if (image.encoding == "rgb8")
+    components = 3;
+  else if (image.encoding == "mono8")
+    components = 1;
+  else
+    throw std::runtime_error("unsupported JPEG input encoding: " + image.encoding);
+
+  // MCU size with the default 2x2 luma sampling for colour images
+  const uint32_t mcu_size = components == 3 ? 16 : 8;
+  const uint32_t mcus_per_row = (image.width + mcu_size - 1) / mcu_size;
+  const uint32_t mcu_rows = (image.height + mcu_size - 1) / mcu_size;
+
+  // split into strips of whole MCU rows, within the maximum restart interval
+  uint32_t strip_mcu_rows = (mcu_rows + std::max<std::size_t>(strips, 1) - 1) /
+                            std::max<std::size_t>(strips, 1);
+  strip_mcu_rows = std::min(strip_mcu_rows, restart_interval_max / mcus_per_row);
+  if (strip_mcu_rows == 0)
+    throw std::runtime_error("image too wide for restart markers");
+  const uint32_t strip_rows = strip_mcu_rows * mcu_size;
+  const uint32_t n = (image.height + strip_rows - 1) / strip_rows;
+
+  std::vector<jpeg_buffer_t> buffers(n);
+  pool.parallel_for(n, [&](const std::size_t i) {
+    const uint32_t row_begin = i * strip_rows;
+    encode_rows(image, components, quality, row_begin,
+                std::min(strip_rows, image.height - row_begin), buffers[i]);
+  });
+
+  if (n == 1) {
+    data.assign(buffers[0].data, buffers[0].data + buffers[0].size);
+    return;
+  }
+
+  std::vector<jpeg_layout_t> layouts(n);
+  std::size_t size = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    layouts[i] = parse_layout(buffers[i]);
+    size += layouts[i].scan_end - layouts[i].scan_begin + 2;
+  }
+
+  // headers of the first strip with the full image height and a restart interval
+  const jpeg_layout_t &first = layouts[0];
+  data.clear();
+  data.reserve(first.scan_begin + 6 + size + 2);
+  data.insert(data.end(), buffers[0].data, buffers[0].data + first.sos);
+  data[first.sof + 5] = image.height >> 8;
+  data[first.sof + 6] = image.height & 0xFF;
+
+  const uint32_t restart_interval = strip_mcu_rows * mcus_per_row;
+  data.insert(data.end(), {0xFF, DRI, 0x00, 0x04, uint8_t(restart_interval >> 8),
+                           uint8_t(restart_interval & 0xFF)});
+  data.insert(data.end(), buffers[0].data + first.sos, buffers[0].data + first.scan_begin);
+
+  // entropy-coded segments separated by restart markers
+  for (uint32_t i = 0; i < n; i++) {
+    data.insert(data.end(), buffers[i].data + layouts[i].scan_begin,
+                buffers[i].data + layouts[i].scan_end);
+    if (i < n - 1)
+      data.insert(data.end(), {0xFF, uint8_t(RST0 + (i % 8))});
+  }
+  data.insert(data.end(), {0xFF, EOI});
+}
+
+ImageView
+decode_jpeg(const uint8_t *data, const std::size_t size, const int scale,
+            std::vector<uint8_t> &pixels)
+{
+  jpeg_decompress_struct cinfo;
+  error_manager_t err;
+  cinfo.err = jpeg_std_error(&err.pub);
+  err.pub.error_exit = error_exit;
+  if (setjmp(err.jump)) {
+    jpeg_destroy_decompress(&cinfo);
+    throw std::runtime_error("JPEG decoding failed: " + std::string(err.message));
+  }
+
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo, data, size);
+  jpeg_read_header(&cinfo, TRUE);
+  cinfo.out_color_space = JCS_RGB;
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = scale;
+  // fast integer IDCT and no upsampling of chroma, since the result is coarse anyway
+  cinfo.dct_method = JDCT_IFAST;
+  cinfo.do_fancy_upsampling = FALSE;
+  jpeg_start_decompress(&cinfo);
+
+  // 'error_exit' skips destructors, objects that own memory are only created after
+  // 'jpeg_destroy_decompress', and exceptions destroy 'cinfo' as well
+  const uint32_t width = cinfo.output_width;
+  const uint32_t height = cinfo.output_height;
+  const uint32_t step = width * cinfo.output_components;
+  try {
+    pixels.resize(std::size_t(step) * height);
+  }
+  catch (...) {
+    jpeg_destroy_decompress(&cinfo);
+    throw;
+  }
+  while (cinfo.output_scanline < height) {
+    JSAMPROW row = pixels.data() + std::size_t(cinfo.output_scanline) * step;
+    jpeg_read_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  return {pixels.data(), width, height, step, "rgb8"};
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "image_view.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class WorkerPool;
+
+// Encode an 8-bit "mono8" or "rgb8" image to a baseline JPEG with the given quality (1-100).
+//
+// With more than one strip, the image is split into horizontal strips of whole MCU rows that
+// are encoded concurrently on the worker pool with identical tables. The entropy-coded
+// segments of the strips are joined with restart markers into a single image, without
+// recompression. The number of strips is increased if a strip exceeds the maximum
+// restart interval.
+void
+encode_jpeg(const ImageView &image, const int quality, const std::size_t strips,
+            WorkerPool &pool, std::vector<uint8_t> &data);
+
+// Decode a JPEG to "rgb8" at 1/'scale' of its size (1, 2, 4 or 8) with the scaled inverse DCT,
+// which skips most of the decoding work for coarse previews and statistics.
+// Returns the image in 'pixels', valid until the next call with the same buffer.
+ImageView
+decode_jpeg(const uint8_t *data, const std::size_t size, const int scale,
+            std::vector<uint8_t> &pixels);
@@ -0,0 +1,129 @@
+#include "load_shedding.hpp"
+#include <algorithm>
+
+
+// smoothing factor of the exponential moving average of the load
+static constexpr double alpha = 0.1;
+// number of frames after a level change before the load is judged again
+static constexpr uint32_t frames_settle = 10;
+// number of consecutive frames required to increase or decrease the level,
+// recovery is slower to avoid oscillation between levels
+static constexpr uint32_t frames_increase = 5;
+static constexpr uint32_t frames_decrease = 30;
+// fraction of the budget that the load may reach after recovering a level
+static constexpr double recovery_margin = 0.8;
+
+void
+LoadShedding::set_enabled(const bool enabled)
+{
+  this->enabled = enabled;
+  if (!enabled)
+    current_level = NONE;
+}
+
+void
+LoadShedding::set_budget(const double budget)
+{
+  this->budget = budget;
+}
+
+void
+LoadShedding::update(const int64_t duration, const int64_t period)
+{
+  if (period <= 0)
+    return;
+
+  // restart the average on the first frame after a level change,
+  // as it still contains the load of the previous level
+  const double load_frame = double(duration) / double(period);
+  load_avg = frames_level ? (1 - alpha) * load_avg + alpha * load_frame : load_frame;
+  frames_level++;
+
+  const uint8_t level = current_level;
+  if (level != level_prev) {
+    // changed by 'set_enabled'
+    set_level(level, false);
+    return;
+  }
+
+  if (!enabled || frames_level < frames_settle)
+    return;
+
+  // reduction of the load by an escalated level, once the load settled
+  if (frames_level == frames_settle && escalated)
+    load_reduction[level] = std::max(load_before - load_avg, 0.0);
+
+  // count frames over budget, and frames that would stay under budget with the reduction of
+  // the current level restored
+  frames_over = load_avg > budget ? frames_over + 1 : 0;
+  frames_under =
+    load_avg + load_reduction[level] < recovery_margin * budget ? frames_under + 1 : 0;
+
+  if (frames_over >= frames_increase && level < DECIMATE_RAW_MAX)
+    set_level(level + 1, true);
+  else if (frames_under >= frames_decrease && level > NONE)
+    set_level(level - 1, false);
+}
+
+void
+LoadShedding::set_level(const uint8_t level, const bool escalate)
+{
+  load_before = load_avg;
+  escalated = escalate;
+  current_level = level;
+  level_prev = level;
+  frames_level = 0;
+  frames_over = 0;
+  frames_under = 0;
+}
+
+uint8_t
+LoadShedding::level() const
+{
+  return current_level;
+}
+
+double
+LoadShedding::load() const
+{
+  return load_avg;
+}
+
+bool
+LoadShedding::skip_encode() const
+{
+  return current_level >= SKIP_ENCODE;
+}
+
+bool
+LoadShedding::skip_decode() const
+{
+  return current_level >= SKIP_DECODE;
+}
+
+bool
+LoadShedding::drop_raw()
+{
+  const uint8_t level = current_level;
+  if (level < DECIMATE_RAW)
+    return false;
+  // 2^(level - SKIP_DECODE) decimation
+  const uint64_t decimation = uint64_t(1) << (level - SKIP_DECODE);
+  return raw_counter++ % decimation;
+}
+
+std::string
+LoadShedding::describe(const uint8_t level)
+{
+  switch (level) {
+  case NONE:
+    return "none";
+  case SKIP_ENCODE:
+    return "skip compression";
+  case SKIP_DECODE:
+    return "skip compression and decompression";
+  default:
+    return "skip compression and decompression, publish every " +
+           std::to_string(1 << (level - SKIP_DECODE)) + ". raw image";
+  }
+}
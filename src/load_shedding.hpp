@@ -0,0 +1,81 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+
+// Adaptive load shedding that compares the processing time of a frame with the
+// frame period. When the processing time exceeds the budget, work is shed in
+// the order of the levels below. After a level change, the load is measured afresh
+// and judged again once it settled. A level is restored when the load plus the
+// reduction measured when entering the level stays well under the budget.
+class LoadShedding
+{
+public:
+  enum Level : uint8_t
+  {
+    NONE = 0,
+    // skip compression of raw images
+    SKIP_ENCODE = 1,
+    // skip decompression of compressed images
+    SKIP_DECODE = 2,
+    // publish every 2nd, 4th, ... raw image
+    DECIMATE_RAW = 3,
+    DECIMATE_RAW_MAX = 6,
+  };
+
+  void
+  set_enabled(const bool enabled);
+
+  // fraction of the frame period that may be spent on processing
+  void
+  set_budget(const double budget);
+
+  // update the load with the processing duration and frame period (ns)
+  void
+  update(const int64_t duration, const int64_t period);
+
+  uint8_t
+  level() const;
+
+  // average ratio of processing duration to frame period
+  double
+  load() const;
+
+  bool
+  skip_encode() const;
+
+  bool
+  skip_decode() const;
+
+  // count raw images and check if the current one should be dropped
+  bool
+  drop_raw();
+
+  static std::string
+  describe(const uint8_t level);
+
+private:
+  std::atomic<bool> enabled = false;
+  std::atomic<double> budget = 0.9;
+  std::atomic<uint8_t> current_level = NONE;
+  std::atomic<double> load_avg = 0;
+
+  // level seen by the last update, and frames since it was set
+  uint8_t level_prev = NONE;
+  uint32_t frames_level = 0;
+  // level was entered by escalation, with this load at the level below
+  bool escalated = false;
+  double load_before = 0;
+  // load reduction measured after entering each level
+  std::array<double, DECIMATE_RAW_MAX + 1> load_reduction = {};
+
+  // consecutive frames over and under budget
+  uint32_t frames_over = 0;
+  uint32_t frames_under = 0;
+  uint64_t raw_counter = 0;
+
+  void
+  set_level(const uint8_t level, const bool escalate);
+};
@@ -0,0 +1,103 @@
+#include "ordered_workers.hpp"
+#include <utility>
+
+
+OrderedWorkers::OrderedWorkers(const std::size_t threads, const std::size_t window,
+                               const std::function<void()> &init)
+    : window(window), pool(threads, init)
+{}
+
+bool
+OrderedWorkers::admit()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (sequence_submit - sequence_deliver >= window) {
+    jobs_dropped++;
+    return false;
+  }
+  return true;
+}
+
+bool
+OrderedWorkers::submit(std::function<void()> process, std::function<void()> deliver)
+{
+  uint64_t sequence;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (sequence_submit - sequence_deliver >= window) {
+      jobs_dropped++;
+      return false;
+    }
+    sequence = sequence_submit++;
+  }
+
+  pool.run([this, sequence, process = std::move(process), deliver = std::move(deliver)]() {
+    // a failed job still completes its sequence, to not block the delivery of later jobs
+    try {
+      process();
+    }
+    catch (...) {
+      complete(sequence, {});
+      return;
+    }
+    complete(sequence, std::move(deliver));
+  });
+
+  return true;
+}
+
+uint64_t
+OrderedWorkers::dropped() const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return jobs_dropped;
+}
+
+uint64_t
+OrderedWorkers::failed() const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return jobs_failed;
+}
+
+LatencyMonitor &
+OrderedWorkers::latency()
+{
+  return pool.latency();
+}
+
+void
+OrderedWorkers::complete(const uint64_t sequence, std::function<void()> deliver)
+{
+  std::unique_lock<std::mutex> guard(lock);
+  // an empty delivery marks a failed job
+  if (!deliver)
+    jobs_failed++;
+  ready[sequence] = std::move(deliver);
+
+  // only one thread delivers at a time, others leave their result to it
+  if (delivering)
+    return;
+  delivering = true;
+
+  while (!ready.empty() && ready.begin()->first == sequence_deliver) {
+    std::function<void()> next = std::move(ready.begin()->second);
+    ready.erase(ready.begin());
+    guard.unlock();
+    // the sequence advances and delivery continues even if this delivery throws
+    bool delivered = true;
+    try {
+      if (next)
+        next();
+    }
+    catch (...) {
+      delivered = false;
+    }
+    guard.lock();
+    if (!delivered)
+      jobs_failed++;
+    sequence_deliver++;
+  }
+
+  delivering = false;
+}
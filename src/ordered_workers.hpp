@@ -0,0 +1,55 @@
+#pragma once
+#include "worker_pool.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+
+
+// Process jobs for consecutive frames in parallel on a worker pool and deliver
+// their results in the order of submission. At most 'window' jobs are in flight.
+class OrderedWorkers
+{
+public:
+  OrderedWorkers(const std::size_t threads, const std::size_t window,
+                 const std::function<void()> &init = {});
+
+  // returns false and counts a dropped job if the window is full, to skip preparing a job
+  // that 'submit' would reject, the window only frees up until the next 'submit'
+  bool
+  admit();
+
+  // queue 'process' on a worker and call 'deliver' after all previously submitted
+  // jobs have been delivered, returns false without queueing if the window is full
+  bool
+  submit(std::function<void()> process, std::function<void()> deliver);
+
+  // number of jobs that were rejected because the window was full
+  uint64_t
+  dropped() const;
+
+  // number of jobs whose 'process' or 'deliver' threw, they are skipped in the sequence
+  uint64_t
+  failed() const;
+
+  LatencyMonitor &
+  latency();
+
+private:
+  const std::size_t window;
+
+  mutable std::mutex lock;
+  uint64_t sequence_submit = 0;
+  uint64_t sequence_deliver = 0;
+  uint64_t jobs_dropped = 0;
+  uint64_t jobs_failed = 0;
+  // processed jobs waiting for delivery, by sequence
+  std::map<uint64_t, std::function<void()>> ready;
+  bool delivering = false;
+
+  WorkerPool pool;
+
+  void
+  complete(const uint64_t sequence, std::function<void()> deliver);
+};
@@ -1,40 +1,88 @@
 #include "parameter_conflict_check.hpp"
-#include <algorithm>
 #include <rclcpp/parameter.hpp>
+#include <unordered_map>
 
 
-std::tuple<ParameterMap, std::vector<std::string>>
-resolve_conflicts(const ParameterMap &parameters_default, const ParameterMap &parameters_overrides)
+const std::vector<ConflictRule> &
+conflict_rules()
 {
-  ParameterMap parameters_init = parameters_default;
-  std::vector<std::string> msgs;
+  static const std::vector<ConflictRule> rules = {
+    {"AeEnable", "ExposureTime"},
+    {"AeEnable", "AnalogueGain"},
+    {"AwbEnable", "ColourGains"},
+    {"AwbEnable", "ColourTemperature"},
+    {"AfMode", "LensPosition"},
+  };
+  return rules;
+}
 
-  // auto exposure (AeEnable) and manual exposure (ExposureTime)
-  // must not be enabled at the same time
+// rules indexed by the name of the manual control
+static const std::unordered_map<std::string, std::vector<const ConflictRule *>> &
+rules_by_manual()
+{
+  static const std::unordered_map<std::string, std::vector<const ConflictRule *>> index = [] {
+    std::unordered_map<std::string, std::vector<const ConflictRule *>> index;
+    for (const ConflictRule &rule : conflict_rules())
+      index[rule.manual].push_back(&rule);
+    return index;
+  }();
+  return index;
+}
 
-  // default: prefer auto exposure
-  if (parameters_init.count("AeEnable") && parameters_init.at("AeEnable").get<bool>() &&
-      parameters_init.count("ExposureTime"))
-  {
-    // disable exposure
-    parameters_init.erase("ExposureTime");
+static bool
+mode_enabled(const rclcpp::ParameterValue &value)
+{
+  switch (value.get_type()) {
+  case rclcpp::ParameterType::PARAMETER_BOOL:
+    return value.get<bool>();
+  case rclcpp::ParameterType::PARAMETER_INTEGER:
+    return value.get<int64_t>() != 0;
+  default:
+    return false;
   }
+}
+
+static rclcpp::ParameterValue
+mode_disabled(const rclcpp::ParameterValue &value)
+{
+  if (value.get_type() == rclcpp::ParameterType::PARAMETER_INTEGER)
+    return rclcpp::ParameterValue(int64_t(0));
+  return rclcpp::ParameterValue(false);
+}
+
+static bool
+mode_enabled(const ParameterMap &parameters, const char *mode)
+{
+  const ParameterMap::const_iterator it = parameters.find(mode);
+  return it != parameters.end() && mode_enabled(it->second);
+}
+
+std::vector<std::string>
+resolve_conflicts(ParameterMap &parameters, const ParameterMap &parameters_overrides)
+{
+  std::vector<std::string> msgs;
+
+  // default: prefer the automatic mode
+  for (const ConflictRule &rule : conflict_rules())
+    if (mode_enabled(parameters, rule.mode) && !parameters_overrides.count(rule.manual))
+      parameters.erase(rule.manual);
 
   // apply parameter overrides
   for (const auto &[name, value] : parameters_overrides)
-    parameters_init[name] = value;
-
-  // overrides: prefer provided exposure
-  if (parameters_init.count("AeEnable") && parameters_init.at("AeEnable").get<bool>() &&
-      parameters_init.count("ExposureTime"))
-  {
-    // disable auto exposure
-    parameters_init.at("AeEnable") = rclcpp::ParameterValue(false);
-    msgs.emplace_back("AeEnable and ExposureTime must not be enabled at the same time. 'AeEnable' "
-                      "will be set to off.");
+    parameters[name] = value;
+
+  // overrides: prefer the provided manual control
+  for (const ConflictRule &rule : conflict_rules()) {
+    if (mode_enabled(parameters, rule.mode) && parameters.count(rule.manual)) {
+      rclcpp::ParameterValue &mode = parameters.at(rule.mode);
+      mode = mode_disabled(mode);
+      msgs.push_back(std::string(rule.mode) + " and " + rule.manual +
+                     " must not be enabled at the same time. '" + rule.mode +
+                     "' will be set to off.");
+    }
   }
 
-  return {parameters_init, msgs};
+  return msgs;
 }
 
 std::vector<std::string>
@@ -43,26 +91,25 @@ check_conflicts(const std::vector<rclcpp::Parameter> &parameters_new,
 {
   std::vector<std::string> msgs;
 
-  ParameterMap parameter_map;
-  // old configuration state
-  for (const auto &[name, value] : parameters_full)
-    parameter_map[name] = value;
-  // apply new configuration update
-  for (const auto &p : parameters_new)
-    parameter_map[p.get_name()] = p.get_parameter_value();
-
-  // is auto exposure going to be enabled?
-  const bool ae_enabled =
-    parameter_map.count("AeEnable") && parameter_map.at("AeEnable").get<bool>();
-  // are new parameters setting the exposure manually?
-  const bool exposure_updated =
-    std::find_if(parameters_new.begin(), parameters_new.end(), [](const rclcpp::Parameter &param) {
-      return param.get_name() == "ExposureTime";
-    }) != parameters_new.end();
-
-  // ExposureTime must not be set while AeEnable is true
-  if (ae_enabled && exposure_updated)
-    msgs.emplace_back("AeEnable and ExposureTime must not be set simultaneously");
+  const auto &index = rules_by_manual();
+  for (const rclcpp::Parameter &manual : parameters_new) {
+    const auto rules = index.find(manual.get_name());
+    if (rules == index.end())
+      continue;
+
+    for (const ConflictRule *rule : rules->second) {
+      // mode after the update, the last value in the update takes precedence
+      bool enabled = mode_enabled(parameters_full, rule->mode);
+      for (const rclcpp::Parameter &p : parameters_new)
+        if (p.get_name() == rule->mode)
+          enabled = mode_enabled(p.get_parameter_value());
+
+      // the manual control must not be set while the mode is enabled
+      if (enabled)
+        msgs.push_back(std::string(rule->mode) + " and " + rule->manual +
+                       " must not be set simultaneously");
+    }
+  }
 
   return msgs;
 }
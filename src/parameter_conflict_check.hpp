@@ -2,7 +2,6 @@
 #include <map>
 #include <rclcpp/parameter_value.hpp>
 #include <string>
-#include <tuple>
 #include <vector>
 
 
@@ -13,9 +12,28 @@ class Parameter;
 
 typedef std::map<std::string, rclcpp::ParameterValue> ParameterMap;
 
-std::tuple<ParameterMap, std::vector<std::string>>
-resolve_conflicts(const ParameterMap &parameters_default, const ParameterMap &parameters_overrides);
+// An automatic mode and a manual control that must not be enabled at the same time.
+// The mode is enabled for a true boolean or a non-zero integer (e.g. AfMode other than
+// AfModeManual) and is disabled by setting it to false or 0.
+struct ConflictRule
+{
+  const char *mode;
+  const char *manual;
+};
+
+// all rules, e.g. AeEnable/ExposureTime, AwbEnable/ColourGains, AfMode/LensPosition
+const std::vector<ConflictRule> &
+conflict_rules();
+
+// Resolve conflicts of the default parameters and the user provided overrides in place.
+// Manual controls are dropped from the defaults if their mode is enabled by default,
+// and modes are disabled if the overrides enable both the mode and the manual control.
+// Returns one message per disabled mode.
+std::vector<std::string>
+resolve_conflicts(ParameterMap &parameters, const ParameterMap &parameters_overrides);
 
+// Check an update of parameters against the current state. Only the rules of the manual
+// controls in the update are evaluated, with the mode from the update or current state.
 std::vector<std::string>
 check_conflicts(const std::vector<rclcpp::Parameter> &parameters_new,
                 const ParameterMap &parameters_full);
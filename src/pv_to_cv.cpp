@@ -1,5 +1,7 @@
 #include "pv_to_cv.hpp"
+#include "small_buffer.hpp"
 #include "types.hpp"
+#include <algorithm>
 #include <cstdint>
 #include <libcamera/base/span.h>
 #include <libcamera/controls.h>
@@ -15,8 +17,11 @@ pv_to_cv_int_array(const std::vector<int64_t> &values, const libcamera::ControlT
   // convert to Span (Integer32, Integer64) or geometric type Rectangle, Size
   switch (type) {
   case libcamera::ControlTypeInteger32:
-    return {
-      libcamera::Span<const CTInteger32>(std::vector<CTInteger32>(values.begin(), values.end()))};
+  {
+    SmallBuffer<CTInteger32> array(values.size());
+    std::copy(values.begin(), values.end(), array.data());
+    return {array.span()};
+  }
   case libcamera::ControlTypeInteger64:
     return {libcamera::Span<const CTInteger64>(values)};
   case libcamera::ControlTypeRectangle:
@@ -55,9 +60,11 @@ pv_to_cv(const rclcpp::Parameter &parameter, const libcamera::ControlType &type)
     return pv_to_cv_int_array(parameter.as_integer_array(), type);
   case rclcpp::ParameterType::PARAMETER_DOUBLE_ARRAY:
   {
-    // convert to float vector
-    return {libcamera::Span<const CTFloat>(std::vector<CTFloat>(
-      parameter.as_double_array().begin(), parameter.as_double_array().end()))};
+    // convert to float array
+    const std::vector<double> &values = parameter.as_double_array();
+    SmallBuffer<CTFloat> array(values.size());
+    std::copy(values.begin(), values.end(), array.data());
+    return {array.span()};
   }
   case rclcpp::ParameterType::PARAMETER_STRING_ARRAY:
     return {libcamera::Span<const CTString>(parameter.as_string_array())};
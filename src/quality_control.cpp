@@ -0,0 +1,80 @@
+#include "quality_control.hpp"
+#include <algorithm>
+#include <cmath>
+
+
+// smoothing factor of the moving averages
+static constexpr double alpha = 0.2;
+// quality change for a factor e between the compressed and target size
+static constexpr double gain = 8;
+
+void
+QualityControl::set_target_bitrate(const double bitrate)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  target_bitrate = std::max(bitrate, 0.0);
+}
+
+void
+QualityControl::set_target_size(const double size)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  target_size = std::max(size, 0.0);
+}
+
+void
+QualityControl::set_bounds(const int quality_min, const int quality_max)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  this->quality_min = std::clamp(quality_min, 1, 100);
+  this->quality_max = std::clamp(quality_max, this->quality_min, 100);
+  quality_current = std::clamp<double>(quality_current, this->quality_min, this->quality_max);
+}
+
+bool
+QualityControl::enabled() const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return target_bitrate > 0 || target_size > 0;
+}
+
+int
+QualityControl::quality() const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return int(std::lround(quality_current));
+}
+
+void
+QualityControl::update(const std::size_t size, const int64_t timestamp)
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  // frames may be reported out of order by parallel encoders
+  if (timestamp_prev && timestamp > timestamp_prev) {
+    const double interval = (timestamp - timestamp_prev) * 1e-9;
+    interval_avg = interval_avg > 0 ? (1 - alpha) * interval_avg + alpha * interval : interval;
+  }
+  timestamp_prev = std::max(timestamp_prev, timestamp);
+  size_avg = size_avg > 0 ? (1 - alpha) * size_avg + alpha * size : size;
+
+  // target size per frame, the smaller one if both targets are set
+  double target = target_size;
+  if (target_bitrate > 0 && interval_avg > 0) {
+    const double target_frame = target_bitrate * interval_avg;
+    target = target > 0 ? std::min(target, target_frame) : target_frame;
+  }
+  if (target <= 0 || size == 0)
+    return;
+
+  // the compressed size changes roughly exponentially with the quality
+  quality_current += gain * std::log(target / double(size));
+  quality_current = std::clamp<double>(quality_current, quality_min, quality_max);
+}
+
+double
+QualityControl::bitrate() const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return interval_avg > 0 ? size_avg / interval_avg : 0;
+}
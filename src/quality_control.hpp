@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+
+// Adjust the JPEG quality per frame towards a target bitrate (bytes/s) or
+// target size (bytes/frame), based on the sizes of previously compressed frames.
+class QualityControl
+{
+public:
+  // target bytes per second, 0 disables the bitrate target
+  void
+  set_target_bitrate(const double bitrate);
+
+  // target bytes per frame, 0 disables the size target
+  void
+  set_target_size(const double size);
+
+  void
+  set_bounds(const int quality_min, const int quality_max);
+
+  // rate control is active if a target is set
+  bool
+  enabled() const;
+
+  // quality for the next frame
+  int
+  quality() const;
+
+  // update the controller with the compressed size of a frame and its timestamp (ns)
+  void
+  update(const std::size_t size, const int64_t timestamp);
+
+  // achieved bytes per second
+  double
+  bitrate() const;
+
+private:
+  mutable std::mutex lock;
+
+  double target_bitrate = 0;
+  double target_size = 0;
+  int quality_min = 1;
+  int quality_max = 100;
+
+  double quality_current = 80;
+  // moving averages of the frame size and interval (s)
+  double size_avg = 0;
+  double interval_avg = 0;
+  int64_t timestamp_prev = 0;
+};
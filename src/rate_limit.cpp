@@ -0,0 +1,35 @@
+#include "rate_limit.hpp"
+#include <algorithm>
+
+
+void
+RateLimit::set_decimation(const uint32_t decimation)
+{
+  this->decimation = std::max<uint32_t>(decimation, 1);
+}
+
+void
+RateLimit::set_max_rate(const double rate)
+{
+  period = rate > 0 ? int64_t(1e9 / rate) : 0;
+}
+
+bool
+RateLimit::check(const int64_t timestamp)
+{
+  // interval to the previous frame, to tolerate jitter of the sensor timestamps
+  const int64_t interval = timestamp_prev < 0 ? 0 : timestamp - timestamp_prev;
+  timestamp_prev = timestamp;
+
+  // decimation counts all frames
+  if (counter++ % decimation)
+    return false;
+
+  // rate limit only counts published frames
+  if (period && timestamp_published >= 0 &&
+      (timestamp - timestamp_published) + interval / 2 < period)
+    return false;
+
+  timestamp_published = timestamp;
+  return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+
+// Decide per frame if it is published, based on a decimation factor
+// (publish every n-th frame) and a maximum publishing rate.
+class RateLimit
+{
+public:
+  void
+  set_decimation(const uint32_t decimation);
+
+  void
+  set_max_rate(const double rate);
+
+  // check if the frame with the given sensor timestamp (ns) should be published
+  bool
+  check(const int64_t timestamp);
+
+private:
+  std::atomic<uint32_t> decimation = 1;
+  // minimum period (ns) between published frames, 0 for no limit
+  std::atomic<int64_t> period = 0;
+
+  uint64_t counter = 0;
+  int64_t timestamp_prev = -1;
+  int64_t timestamp_published = -1;
+};
@@ -0,0 +1,197 @@
+#include "raw_compression.hpp"
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <lz4.h>
+#include <sensor_msgs/image_encodings.hpp>
+#include <stdexcept>
+
+
+static constexpr uint32_t magic = 0x345a4c52; // "RLZ4"
+static constexpr uint16_t version = 1;
+static constexpr uint16_t flag_delta = 1 << 0;
+
+// layout of the samples in a row for delta prediction
+struct sample_layout_t
+{
+  // bytes per sample
+  std::size_t size;
+  // distance between samples of the same colour channel
+  std::size_t distance;
+};
+
+static sample_layout_t
+get_sample_layout(const std::string &encoding)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  const std::size_t size = enc::bitDepth(encoding) > 8 ? 2 : 1;
+  const std::size_t distance = enc::isBayer(encoding) ? 2 : enc::numChannels(encoding);
+  return {size, std::max<std::size_t>(distance, 1)};
+}
+
+template<typename T>
+static void
+delta_encode(const T *src, T *dst, const std::size_t n, const std::size_t distance)
+{
+  std::copy_n(src, std::min(n, distance), dst);
+  for (std::size_t i = distance; i < n; i++)
+    dst[i] = T(src[i] - src[i - distance]);
+}
+
+template<typename T>
+static void
+delta_decode(T *data, const std::size_t n, const std::size_t distance)
+{
+  for (std::size_t i = distance; i < n; i++)
+    data[i] = T(data[i] + data[i - distance]);
+}
+
+std::string
+raw_compression_format(const std::string &encoding, const bool delta)
+{
+  return encoding + (delta ? "; lz4 delta" : "; lz4");
+}
+
+void
+compress_raw(const ImageView &image, const bool delta, WorkerPool &pool,
+             std::vector<uint8_t> &data)
+{
+  const sample_layout_t layout = get_sample_layout(image.encoding);
+  if (delta && image.step % layout.size)
+    throw std::runtime_error("row length is not a multiple of the sample size");
+
+  // two bands per thread for load balancing
+  const uint32_t bands_max = 2 * (pool.size() + 1);
+  const uint32_t band_rows = std::max<uint32_t>((image.height + bands_max - 1) / bands_max, 1);
+  const uint32_t bands = (image.height + band_rows - 1) / band_rows;
+
+  const int band_bytes_max = int(band_rows * image.step);
+  const std::size_t bound = LZ4_compressBound(band_bytes_max);
+  const std::size_t offset_payload = sizeof(RawCompressionHeader) + bands * sizeof(uint32_t);
+
+  // compress every band into a slot of the maximum compressed size
+  data.resize(offset_payload + bands * bound);
+  std::vector<uint32_t> sizes(bands);
+
+  pool.parallel_for(bands, [&](const std::size_t band) {
+    const uint32_t row_begin = band * band_rows;
+    const uint32_t rows = std::min(band_rows, image.height - row_begin);
+    const uint8_t *src = image.data + std::size_t(row_begin) * image.step;
+    const std::size_t size = std::size_t(rows) * image.step;
+
+    thread_local std::vector<uint8_t> residuals;
+    if (delta) {
+      residuals.resize(size);
+      for (uint32_t row = 0; row < rows; row++) {
+        const std::size_t o = std::size_t(row) * image.step;
+        if (layout.size == 2)
+          delta_encode(reinterpret_cast<const uint16_t *>(src + o),
+                       reinterpret_cast<uint16_t *>(residuals.data() + o), image.step / 2,
+                       layout.distance);
+        else
+          delta_encode(src + o, residuals.data() + o, image.step, layout.distance);
+      }
+      src = residuals.data();
+    }
+
+    const int compressed =
+      LZ4_compress_default(reinterpret_cast<const char *>(src),
+                           reinterpret_cast<char *>(data.data() + offset_payload + band * bound),
+                           int(size), int(bound));
+    if (compressed <= 0)
+      throw std::runtime_error("LZ4 compression failed");
+    sizes[band] = compressed;
+  });
+
+  // pack the compressed bands
+  std::size_t offset = offset_payload;
+  for (uint32_t band = 0; band < bands; band++) {
+    std::memmove(data.data() + offset, data.data() + offset_payload + band * bound, sizes[band]);
+    offset += sizes[band];
+  }
+  data.resize(offset);
+
+  RawCompressionHeader header;
+  header.magic = magic;
+  header.version = version;
+  header.flags = delta ? flag_delta : 0;
+  header.width = image.width;
+  header.height = image.height;
+  header.step = image.step;
+  header.band_rows = band_rows;
+  header.bands = bands;
+  std::memcpy(data.data(), &header, sizeof(header));
+  std::memcpy(data.data() + sizeof(header), sizes.data(), bands * sizeof(uint32_t));
+}
+
+RawCompressionHeader
+decompress_raw(const uint8_t *data, const std::size_t size, const std::string &encoding,
+               WorkerPool &pool, std::vector<uint8_t> &pixels)
+{
+  RawCompressionHeader header;
+  if (size < sizeof(header))
+    throw std::runtime_error("compressed raw image too short");
+  std::memcpy(&header, data, sizeof(header));
+  if (header.magic != magic || header.version != version)
+    throw std::runtime_error("invalid compressed raw image header");
+
+  // the header is untrusted, the band layout must cover exactly the rows of the image
+  // and every row must hold 'width' samples of the encoding
+  namespace enc = sensor_msgs::image_encodings;
+  const sample_layout_t layout = get_sample_layout(encoding);
+  const uint64_t pixel_bytes = std::max(enc::bitDepth(encoding) / 8, 1) *
+                               std::max(enc::numChannels(encoding), 1);
+  const uint64_t bands =
+    header.band_rows ? (uint64_t(header.height) + header.band_rows - 1) / header.band_rows : 0;
+  if (!header.band_rows || header.bands != bands)
+    throw std::runtime_error("invalid band layout in compressed raw image");
+  if (header.step < uint64_t(header.width) * pixel_bytes || header.step % layout.size)
+    throw std::runtime_error("invalid row length in compressed raw image");
+  if (uint64_t(std::min(header.band_rows, header.height)) * header.step > INT_MAX)
+    throw std::runtime_error("band of compressed raw image too large");
+
+  const std::size_t offset_payload = sizeof(header) + header.bands * sizeof(uint32_t);
+  if (size < offset_payload)
+    throw std::runtime_error("compressed raw image too short");
+
+  // offsets of the compressed bands
+  std::vector<uint32_t> sizes(header.bands);
+  std::memcpy(sizes.data(), data + sizeof(header), header.bands * sizeof(uint32_t));
+  std::vector<std::size_t> offsets(header.bands);
+  uint64_t offset = offset_payload;
+  for (uint32_t band = 0; band < header.bands; band++) {
+    offsets[band] = offset;
+    offset += sizes[band];
+  }
+  if (offset > size)
+    throw std::runtime_error("compressed raw image too short");
+
+  const bool delta = header.flags & flag_delta;
+
+  pixels.resize(std::size_t(header.height) * header.step);
+
+  pool.parallel_for(header.bands, [&](const std::size_t band) {
+    const uint32_t row_begin = band * header.band_rows;
+    const uint32_t rows = std::min(header.band_rows, header.height - row_begin);
+    uint8_t *dst = pixels.data() + std::size_t(row_begin) * header.step;
+    const int band_size = int(rows * header.step);
+
+    if (LZ4_decompress_safe(reinterpret_cast<const char *>(data + offsets[band]),
+                            reinterpret_cast<char *>(dst), int(sizes[band]),
+                            band_size) != band_size)
+      throw std::runtime_error("LZ4 decompression failed");
+
+    if (delta) {
+      for (uint32_t row = 0; row < rows; row++) {
+        uint8_t *r = dst + std::size_t(row) * header.step;
+        if (layout.size == 2)
+          delta_decode(reinterpret_cast<uint16_t *>(r), header.step / 2, layout.distance);
+        else
+          delta_decode(r, header.step, layout.distance);
+      }
+    }
+  });
+
+  return header;
+}
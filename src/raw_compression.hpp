@@ -0,0 +1,49 @@
+#pragma once
+#include "image_view.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class WorkerPool;
+
+// Lossless compression of raw images (e.g. Bayer or mono) for 'sensor_msgs/CompressedImage'.
+//
+// The image is split into bands of rows that are compressed independently with LZ4 on the
+// worker pool. With delta prediction, each sample of a row is replaced by its difference to
+// the previous sample of the same colour channel, which is 2 samples apart for Bayer patterns.
+//
+// The 'format' of the message is "<encoding>; lz4" or "<encoding>; lz4 delta",
+// e.g. "bayer_rggb8; lz4 delta". The 'data' in host byte order consists of:
+//   1. RawCompressionHeader
+//   2. 'bands' times uint32_t with the compressed size of each band
+//   3. the LZ4 blocks of all bands
+// All bands have 'band_rows' rows of 'step' bytes, except for the last band
+// which has the remaining rows.
+
+struct RawCompressionHeader
+{
+  // "RLZ4"
+  uint32_t magic;
+  uint16_t version;
+  // bit 0: delta prediction
+  uint16_t flags;
+  uint32_t width;
+  uint32_t height;
+  uint32_t step;
+  uint32_t band_rows;
+  uint32_t bands;
+};
+
+std::string
+raw_compression_format(const std::string &encoding, const bool delta);
+
+// compress the image into 'data', which is resized to the compressed size
+void
+compress_raw(const ImageView &image, const bool delta, WorkerPool &pool,
+             std::vector<uint8_t> &data);
+
+// decompress 'data' into 'pixels', returns the header
+RawCompressionHeader
+decompress_raw(const uint8_t *data, const std::size_t size, const std::string &encoding,
+               WorkerPool &pool, std::vector<uint8_t> &pixels);
@@ -0,0 +1,266 @@
+#include "rectification.hpp"
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <sensor_msgs/image_encodings.hpp>
+#include <stdexcept>
+
+
+// fixed-point bilinear weights
+static constexpr int weight_bits = 7;
+static constexpr int weight_one = 1 << weight_bits;
+static constexpr uint16_t invalid = 0xFFFF;
+
+typedef std::array<double, 9> matrix_t;
+
+static bool
+is_zero(const matrix_t &m)
+{
+  return std::all_of(m.begin(), m.end(), [](const double v) { return v == 0; });
+}
+
+static matrix_t
+multiply(const matrix_t &a, const matrix_t &b)
+{
+  matrix_t c = {};
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      for (int k = 0; k < 3; k++)
+        c[3 * i + j] += a[3 * i + k] * b[3 * k + j];
+  return c;
+}
+
+static matrix_t
+invert(const matrix_t &m)
+{
+  const double det = m[0] * (m[4] * m[8] - m[5] * m[7]) - m[1] * (m[3] * m[8] - m[5] * m[6]) +
+                     m[2] * (m[3] * m[7] - m[4] * m[6]);
+  if (det == 0)
+    throw std::runtime_error("singular rectification matrix");
+  return {(m[4] * m[8] - m[5] * m[7]) / det, (m[2] * m[7] - m[1] * m[8]) / det,
+          (m[1] * m[5] - m[2] * m[4]) / det, (m[5] * m[6] - m[3] * m[8]) / det,
+          (m[0] * m[8] - m[2] * m[6]) / det, (m[2] * m[3] - m[0] * m[5]) / det,
+          (m[3] * m[7] - m[4] * m[6]) / det, (m[1] * m[6] - m[0] * m[7]) / det,
+          (m[0] * m[4] - m[1] * m[3]) / det};
+}
+
+static bool
+same_calibration(const sensor_msgs::msg::CameraInfo &a, const sensor_msgs::msg::CameraInfo &b)
+{
+  return a.width == b.width && a.height == b.height && a.distortion_model == b.distortion_model &&
+         a.d == b.d && a.k == b.k && a.r == b.r && a.p == b.p;
+}
+
+bool
+rectification_supported(const std::string &encoding)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  return encoding == enc::MONO8 || encoding == enc::RGB8 || encoding == enc::BGR8 ||
+         encoding == enc::RGBA8 || encoding == enc::BGRA8 || encoding == enc::YUV422 ||
+         encoding == enc::YUV422_YUY2;
+}
+
+bool
+RectificationMap::update(const sensor_msgs::msg::CameraInfo &info)
+{
+  if (same_calibration(info, calibration))
+    return valid;
+
+  calibration = info;
+  map.clear();
+  valid = false;
+
+  const matrix_t k = info.k;
+  if (is_zero(k) || !info.width || !info.height || info.width >= invalid ||
+      info.height >= invalid)
+    return false;
+
+  // distortion coefficients k1, k2, p1, p2, k3, k4, k5, k6
+  std::array<double, 8> d = {};
+  if (info.distortion_model == "plumb_bob" || info.distortion_model == "rational_polynomial" ||
+      info.distortion_model.empty())
+    std::copy_n(info.d.begin(), std::min<std::size_t>(info.d.size(), d.size()), d.begin());
+  else
+    return false;
+
+  // inverse of the new camera matrix and rectification
+  matrix_t r = info.r;
+  if (is_zero(r))
+    r = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+  matrix_t p = {info.p[0], info.p[1], info.p[2], info.p[4], info.p[5],
+                info.p[6], info.p[8], info.p[9], info.p[10]};
+  if (is_zero(p))
+    p = k;
+  const matrix_t ir = invert(multiply(p, r));
+
+  map.resize(std::size_t(info.width) * info.height);
+  for (uint32_t v = 0; v < info.height; v++) {
+    for (uint32_t u = 0; u < info.width; u++) {
+      // normalised coordinates of the ray
+      const double w = ir[6] * u + ir[7] * v + ir[8];
+      const double x = (ir[0] * u + ir[1] * v + ir[2]) / w;
+      const double y = (ir[3] * u + ir[4] * v + ir[5]) / w;
+
+      // distorted position in the source image
+      const double r2 = x * x + y * y;
+      const double kr = (1 + ((d[4] * r2 + d[1]) * r2 + d[0]) * r2) /
+                        (1 + ((d[7] * r2 + d[6]) * r2 + d[5]) * r2);
+      const double xd = x * kr + 2 * d[2] * x * y + d[3] * (r2 + 2 * x * x);
+      const double yd = y * kr + d[2] * (r2 + 2 * y * y) + 2 * d[3] * x * y;
+      const double sx = k[0] * xd + k[1] * yd + k[2];
+      const double sy = k[4] * yd + k[5];
+
+      entry_t &e = map[std::size_t(v) * info.width + u];
+      if (!(sx >= 0 && sy >= 0 && sx <= info.width - 1 && sy <= info.height - 1)) {
+        e = {invalid, invalid, 0, 0};
+        continue;
+      }
+
+      // top-left neighbour within the image, such that the bottom-right neighbour exists
+      const int x0 = std::min<int>(sx, int(info.width) - 2);
+      const int y0 = std::min<int>(sy, int(info.height) - 2);
+      e.x = std::max(x0, 0);
+      e.y = std::max(y0, 0);
+      e.wx = std::clamp<int>(std::lround((sx - e.x) * weight_one), 0, weight_one);
+      e.wy = std::clamp<int>(std::lround((sy - e.y) * weight_one), 0, weight_one);
+    }
+  }
+
+  valid = true;
+  return valid;
+}
+
+uint32_t
+RectificationMap::width() const
+{
+  return calibration.width;
+}
+
+uint32_t
+RectificationMap::height() const
+{
+  return calibration.height;
+}
+
+// fixed-point weights of the four neighbours
+struct weights_t
+{
+  int w00, w01, w10, w11;
+
+  weights_t(const int wx, const int wy)
+      : w00((weight_one - wx) * (weight_one - wy)), w01(wx * (weight_one - wy)),
+        w10((weight_one - wx) * wy), w11(wx * wy)
+  {}
+};
+
+static inline uint8_t
+interpolate(const uint8_t a, const uint8_t b, const uint8_t c, const uint8_t d,
+            const weights_t &w)
+{
+  return (a * w.w00 + b * w.w01 + c * w.w10 + d * w.w11 + (1 << (2 * weight_bits - 1))) >>
+         (2 * weight_bits);
+}
+
+// interleaved 8-bit channels, the channel loop is unrolled for a constant count
+template<int C, typename Entry>
+static void
+remap_rows(const ImageView &src, uint8_t *dst, const Entry *map, const uint32_t row_begin,
+           const uint32_t rows)
+{
+  for (uint32_t row = row_begin; row < row_begin + rows; row++) {
+    const Entry *m = map + std::size_t(row) * src.width;
+    uint8_t *d = dst + std::size_t(row) * src.step;
+    for (uint32_t x = 0; x < src.width; x++, d += C) {
+      const Entry e = m[x];
+      if (e.x == invalid) {
+        std::memset(d, 0, C);
+        continue;
+      }
+      const uint8_t *p0 = src.data + std::size_t(e.y) * src.step + std::size_t(e.x) * C;
+      const uint8_t *p1 = p0 + src.step;
+      const weights_t w(e.wx, e.wy);
+      for (int c = 0; c < C; c++)
+        d[c] = interpolate(p0[c], p0[c + C], p1[c], p1[c + C], w);
+    }
+  }
+}
+
+// packed 4:2:2 with luma at 'y' and chroma of the pair at 'u' and 'v' bytes per pixel pair,
+// the last pixel of an odd width only has its luma and 'u' chroma byte
+template<int Y, int U, int V, typename Entry>
+static void
+remap_rows_yuv422(const ImageView &src, uint8_t *dst, const Entry *map,
+                  const uint32_t row_begin, const uint32_t rows)
+{
+  // chroma is sampled from complete pairs only
+  const uint32_t pair_last = (src.width - 2) & ~1u;
+  for (uint32_t row = row_begin; row < row_begin + rows; row++) {
+    const Entry *m = map + std::size_t(row) * src.width;
+    uint8_t *d = dst + std::size_t(row) * src.step;
+    for (uint32_t x = 0; x < src.width; x += 2, d += 4) {
+      const uint32_t n = std::min<uint32_t>(src.width - x, 2);
+      // neutral grey outside of the source image
+      uint8_t pair[4] = {128, 128, 128, 128};
+      for (uint32_t i = 0; i < n; i++) {
+        const Entry e = m[x + i];
+        if (e.x == invalid) {
+          pair[Y + 2 * i] = 0;
+          continue;
+        }
+        const uint8_t *p0 = src.data + std::size_t(e.y) * src.step;
+        const uint8_t *p1 = p0 + src.step;
+        const std::size_t o = std::size_t(e.x) * 2 + Y;
+        pair[Y + 2 * i] = interpolate(p0[o], p0[o + 2], p1[o], p1[o + 2], weights_t(e.wx, e.wy));
+        if (i == 0) {
+          // pair of the nearest source pixel
+          const uint32_t nearest = e.x + (e.wx >= weight_one / 2);
+          const std::size_t c = std::size_t(std::min(nearest & ~1u, pair_last)) * 2;
+          const weights_t w(0, e.wy);
+          pair[U] = interpolate(p0[c + U], p0[c + U], p1[c + U], p1[c + U], w);
+          pair[V] = interpolate(p0[c + V], p0[c + V], p1[c + V], p1[c + V], w);
+        }
+      }
+      std::memcpy(d, pair, n * 2);
+    }
+  }
+}
+
+void
+RectificationMap::remap(const ImageView &src, uint8_t *dst, WorkerPool &pool) const
+{
+  namespace enc = sensor_msgs::image_encodings;
+
+  if (!valid)
+    throw std::runtime_error("no valid calibration for rectification");
+  if (src.width != calibration.width || src.height != calibration.height)
+    throw std::runtime_error("image size " + std::to_string(src.width) + "x" +
+                             std::to_string(src.height) + " does not match calibration " +
+                             std::to_string(calibration.width) + "x" +
+                             std::to_string(calibration.height));
+
+  void (*kernel)(const ImageView &, uint8_t *, const entry_t *, uint32_t, uint32_t);
+  if (src.encoding == enc::MONO8)
+    kernel = remap_rows<1, entry_t>;
+  else if (src.encoding == enc::RGB8 || src.encoding == enc::BGR8)
+    kernel = remap_rows<3, entry_t>;
+  else if (src.encoding == enc::RGBA8 || src.encoding == enc::BGRA8)
+    kernel = remap_rows<4, entry_t>;
+  else if (src.encoding == enc::YUV422)
+    kernel = remap_rows_yuv422<1, 0, 2, entry_t>;
+  else if (src.encoding == enc::YUV422_YUY2)
+    kernel = remap_rows_yuv422<0, 1, 3, entry_t>;
+  else
+    throw std::runtime_error("unsupported rectification encoding: " + src.encoding);
+
+  // two bands per thread for load balancing
+  const uint32_t bands_max = 2 * (pool.size() + 1);
+  const uint32_t band_rows = std::max<uint32_t>((src.height + bands_max - 1) / bands_max, 1);
+  const uint32_t bands = (src.height + band_rows - 1) / band_rows;
+
+  pool.parallel_for(bands, [&](const std::size_t band) {
+    const uint32_t row_begin = band * band_rows;
+    kernel(src, dst, map.data(), row_begin, std::min(band_rows, src.height - row_begin));
+  });
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "image_view.hpp"
+#include <cstdint>
+#include <sensor_msgs/msg/camera_info.hpp>
+#include <string>
+#include <vector>
+
+class WorkerPool;
+
+// Rectification of images with the calibration from 'sensor_msgs/CameraInfo'.
+//
+// For every pixel of the rectified image, the position in the distorted image is computed
+// once per calibration with the 'plumb_bob' or 'rational_polynomial' model and stored as
+// the integer position of the top-left neighbour with 7-bit fixed-point bilinear weights.
+// The table is stored in the row-major order of the rectified image, such that the rows are
+// remapped in bands on the worker pool with sequential table reads.
+//
+// Supported are 8-bit "mono8", "rgb8", "bgr8", "rgba8", "bgra8" and the packed "yuv422" and
+// "yuv422_yuy2" encodings. For the latter, luma is interpolated bilinearly and chroma of a
+// pixel pair is interpolated between the rows of the neighbouring source pair.
+
+bool
+rectification_supported(const std::string &encoding);
+
+class RectificationMap
+{
+public:
+  // recompute the tables if the calibration changed,
+  // returns false if the calibration has no camera matrix or an unsupported model
+  bool
+  update(const sensor_msgs::msg::CameraInfo &info);
+
+  // rectify an image of the calibrated size into 'dst' with the same encoding and step
+  void
+  remap(const ImageView &src, uint8_t *dst, WorkerPool &pool) const;
+
+  uint32_t
+  width() const;
+
+  uint32_t
+  height() const;
+
+private:
+  struct entry_t
+  {
+    // top-left source pixel, 'x' is 0xFFFF outside of the source image
+    uint16_t x;
+    uint16_t y;
+    // weights of the right and bottom neighbours
+    uint8_t wx;
+    uint8_t wy;
+  };
+
+  sensor_msgs::msg::CameraInfo calibration;
+  bool valid = false;
+  std::vector<entry_t> map;
+};
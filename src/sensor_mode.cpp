@@ -0,0 +1,58 @@
+#include "sensor_mode.hpp"
+#include <cstdint>
+#include <sstream>
+
+
+std::ostream &
+operator<<(std::ostream &out, const SensorMode &mode)
+{
+  out << mode.format << " " << mode.size.toString() << " @ ";
+  if (mode.fps_max > 0)
+    out << mode.fps_max << " fps";
+  else
+    out << "unknown fps";
+  return out;
+}
+
+std::tuple<std::optional<std::size_t>, std::vector<std::string>>
+select_sensor_mode(const std::vector<SensorMode> &modes, const libcamera::Size &size,
+                   const double fps)
+{
+  std::optional<std::size_t> selected;
+  std::vector<std::string> msgs(modes.size());
+
+  for (std::size_t i = 0; i < modes.size(); i++) {
+    const SensorMode &mode = modes[i];
+    std::ostringstream reason;
+
+    if (!size.isNull() && (mode.size.width < size.width || mode.size.height < size.height)) {
+      reason << "size " << mode.size.toString() << " smaller than " << size.toString();
+    }
+    else if (mode.fps_max < fps) {
+      reason << "frame rate " << mode.fps_max << " lower than " << fps;
+    }
+    else if (selected) {
+      // prefer fewer pixels per frame and a higher frame rate for equal readout cost
+      const SensorMode &best = modes[selected.value()];
+      const uint64_t cost = uint64_t(mode.size.width) * mode.size.height;
+      const uint64_t cost_best = uint64_t(best.size.width) * best.size.height;
+      if (cost < cost_best || (cost == cost_best && mode.fps_max > best.fps_max)) {
+        msgs[selected.value()] = "higher readout cost than " + modes[i].size.toString();
+        selected = i;
+      }
+      else {
+        reason << "higher readout cost than " << best.size.toString();
+      }
+    }
+    else {
+      selected = i;
+    }
+
+    msgs[i] = reason.str();
+  }
+
+  if (selected)
+    msgs[selected.value()] = "selected";
+
+  return {selected, msgs};
+}
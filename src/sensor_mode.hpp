@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <libcamera/geometry.h>
+#include <libcamera/pixel_format.h>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+
+struct SensorMode
+{
+  libcamera::PixelFormat format;
+  libcamera::Size size;
+  // maximum frame rate (Hz) derived from the minimum frame duration, 0 if unknown
+  double fps_max;
+};
+
+std::ostream &
+operator<<(std::ostream &out, const SensorMode &mode);
+
+// select the sensor mode with the lowest readout cost (pixels per frame) that
+// covers the requested output size and provides at least the requested frame rate,
+// returns the index of the selected mode and one status message per mode
+std::tuple<std::optional<std::size_t>, std::vector<std::string>>
+select_sensor_mode(const std::vector<SensorMode> &modes, const libcamera::Size &size,
+                   const double fps);
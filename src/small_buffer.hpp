@@ -0,0 +1,54 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <libcamera/base/span.h>
+#include <memory>
+
+
+// Temporary array of 'size' elements, stored in place up to N elements and on the heap
+// otherwise. Fixed-extent controls such as ColourGains (2) and ColourCorrectionMatrix (9)
+// are converted without heap allocation.
+template<typename T, std::size_t N = 16>
+class SmallBuffer
+{
+public:
+  explicit SmallBuffer(const std::size_t size)
+      : heap(size > N ? new T[size] : nullptr), ptr(size > N ? heap.get() : local.data()),
+        n(size)
+  {}
+
+  SmallBuffer(const SmallBuffer &) = delete;
+
+  SmallBuffer &
+  operator=(const SmallBuffer &) = delete;
+
+  T *
+  data()
+  {
+    return ptr;
+  }
+
+  std::size_t
+  size() const
+  {
+    return n;
+  }
+
+  T &
+  operator[](const std::size_t i)
+  {
+    return ptr[i];
+  }
+
+  libcamera::Span<const T>
+  span() const
+  {
+    return {ptr, n};
+  }
+
+private:
+  std::array<T, N> local;
+  std::unique_ptr<T[]> heap;
+  T *ptr;
+  std::size_t n;
+};
@@ -0,0 +1,70 @@
+#include "thread_scheduling.hpp"
+#include <algorithm>
+#include <cstring>
+#include <pthread.h>
+#include <stdexcept>
+
+
+std::optional<int>
+get_sched_policy(const std::string &name)
+{
+  if (name == "keep")
+    return std::nullopt;
+  if (name == "other")
+    return SCHED_OTHER;
+  if (name == "fifo")
+    return SCHED_FIFO;
+  if (name == "rr")
+    return SCHED_RR;
+  throw std::runtime_error("invalid scheduling policy: \"" + name + "\"");
+}
+
+void
+apply_scheduling(const ThreadScheduling &scheduling)
+{
+  // only change what is configured, to keep scheduling inherited from chrt or systemd
+  if (scheduling.policy) {
+    sched_param param = {};
+    if (scheduling.policy != SCHED_OTHER)
+      param.sched_priority = scheduling.priority;
+    // pthread functions return the error instead of setting errno
+    const int err = pthread_setschedparam(pthread_self(), scheduling.policy.value(), &param);
+    if (err)
+      throw std::runtime_error("failed to set scheduling policy: " +
+                               std::string(std::strerror(err)));
+  }
+
+  if (scheduling.cpus.empty())
+    return;
+
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  for (const int cpu : scheduling.cpus) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+      throw std::runtime_error("invalid CPU: " + std::to_string(cpu));
+    CPU_SET(cpu, &cpus);
+  }
+  const int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+  if (err)
+    throw std::runtime_error("failed to set CPU affinity: " + std::string(std::strerror(err)));
+}
+
+void
+LatencyMonitor::add(const int64_t latency)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  count++;
+  sum += latency;
+  max = std::max(max, latency);
+}
+
+LatencyMonitor::Statistics
+LatencyMonitor::collect()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  const Statistics stats = {count, count ? double(sum) / count : 0, max};
+  count = 0;
+  sum = 0;
+  max = 0;
+  return stats;
+}
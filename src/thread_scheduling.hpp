@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <sched.h>
+#include <string>
+#include <vector>
+
+
+// scheduling policy, priority and CPU affinity of a thread
+struct ThreadScheduling
+{
+  // one of SCHED_OTHER, SCHED_FIFO or SCHED_RR, unset keeps the inherited policy
+  std::optional<int> policy;
+  // static priority of the real-time policies
+  int priority = 0;
+  // allowed CPUs, empty keeps the inherited affinity
+  std::vector<int> cpus;
+};
+
+// policy by name, one of {keep, other, fifo, rr}, "keep" maps to an unset policy
+std::optional<int>
+get_sched_policy(const std::string &name);
+
+// apply the configured parts of the scheduling to the calling thread,
+// real-time policies require CAP_SYS_NICE
+void
+apply_scheduling(const ThreadScheduling &scheduling);
+
+// Collect the latency (ns) between waking up a thread and running it.
+class LatencyMonitor
+{
+public:
+  struct Statistics
+  {
+    uint64_t count;
+    double mean;
+    int64_t max;
+  };
+
+  void
+  add(const int64_t latency);
+
+  // statistics since the last call
+  Statistics
+  collect();
+
+private:
+  std::mutex lock;
+  uint64_t count = 0;
+  int64_t sum = 0;
+  int64_t max = 0;
+};
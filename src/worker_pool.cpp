@@ -0,0 +1,124 @@
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+
+WorkerPool::WorkerPool(const std::size_t threads, const std::function<void()> &init)
+{
+  for (std::size_t i = 0; i < threads; i++)
+    workers.emplace_back(&WorkerPool::work, this, init);
+}
+
+WorkerPool::~WorkerPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(tasks_lock);
+    stop = true;
+  }
+  tasks_cv.notify_all();
+  for (std::thread &worker : workers)
+    worker.join();
+}
+
+std::size_t
+WorkerPool::size() const
+{
+  return workers.size();
+}
+
+void
+WorkerPool::run(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> lock(tasks_lock);
+    tasks.push_back({std::chrono::steady_clock::now(), std::move(task)});
+  }
+  tasks_cv.notify_one();
+}
+
+void
+WorkerPool::parallel_for(const std::size_t n, const std::function<void(std::size_t)> &fn)
+{
+  if (n == 0)
+    return;
+
+  if (workers.empty() || n == 1) {
+    for (std::size_t i = 0; i < n; i++)
+      fn(i);
+    return;
+  }
+
+  // shared state, the calling thread and the workers take indices until all are processed
+  struct state_t
+  {
+    std::atomic<std::size_t> next = 0;
+    std::size_t done = 0;
+    std::exception_ptr error;
+    std::mutex lock;
+    std::condition_variable cv;
+  };
+  const std::shared_ptr<state_t> state = std::make_shared<state_t>();
+
+  const auto process = [state, n, &fn]() {
+    std::size_t processed = 0;
+    std::exception_ptr error;
+    for (std::size_t i = state->next++; i < n; i = state->next++) {
+      try {
+        fn(i);
+      }
+      catch (...) {
+        error = std::current_exception();
+      }
+      processed++;
+    }
+    if (processed) {
+      std::lock_guard<std::mutex> lock(state->lock);
+      state->done += processed;
+      if (error)
+        state->error = error;
+    }
+    state->cv.notify_all();
+  };
+
+  const std::size_t helpers = std::min(workers.size(), n - 1);
+  for (std::size_t i = 0; i < helpers; i++)
+    run(process);
+
+  process();
+
+  // forward exceptions from the workers to the caller
+  std::unique_lock<std::mutex> lock(state->lock);
+  state->cv.wait(lock, [&state, n]() { return state->done == n; });
+  if (state->error)
+    std::rethrow_exception(state->error);
+}
+
+LatencyMonitor &
+WorkerPool::latency()
+{
+  return wakeup_latency;
+}
+
+void
+WorkerPool::work(const std::function<void()> &init)
+{
+  if (init)
+    init();
+
+  while (true) {
+    task_t task;
+    {
+      std::unique_lock<std::mutex> lock(tasks_lock);
+      tasks_cv.wait(lock, [this]() { return stop || !tasks.empty(); });
+      if (stop && tasks.empty())
+        return;
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    wakeup_latency.add(
+      std::chrono::nanoseconds(std::chrono::steady_clock::now() - task.queued).count());
+    task.fn();
+  }
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "thread_scheduling.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Fixed set of worker threads that execute tasks in the order of submission.
+class WorkerPool
+{
+public:
+  // 'init' is called on every worker before it takes tasks
+  explicit WorkerPool(const std::size_t threads, const std::function<void()> &init = {});
+
+  ~WorkerPool();
+
+  std::size_t
+  size() const;
+
+  // queue a task for execution on one of the workers
+  void
+  run(std::function<void()> task);
+
+  // execute 'fn(i)' for i in [0, n) on the workers and the calling thread,
+  // returns when all calls finished
+  void
+  parallel_for(const std::size_t n, const std::function<void(std::size_t)> &fn);
+
+  // latency between queueing a task and running it, including the wake-up of a worker
+  LatencyMonitor &
+  latency();
+
+private:
+  struct task_t
+  {
+    std::chrono::steady_clock::time_point queued;
+    std::function<void()> fn;
+  };
+
+  std::vector<std::thread> workers;
+  std::deque<task_t> tasks;
+  std::mutex tasks_lock;
+  std::condition_variable tasks_cv;
+  bool stop = false;
+  LatencyMonitor wakeup_latency;
+
+  void
+  work(const std::function<void()> &init);
+};
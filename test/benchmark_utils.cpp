@@ -0,0 +1,517 @@
+#include "../src/clamp.hpp"
+#include "../src/cv_to_pv.hpp"
+#include "../src/format_mapping.hpp"
+#include "../src/frame_copy.hpp"
+#include "../src/frame_recorder.hpp"
+#include "../src/parameter_conflict_check.hpp"
+#include "../src/pv_to_cv.hpp"
+#include "../src/raw_compression.hpp"
+#include "../src/type_extent.hpp"
+#include "../src/types.hpp"
+#include "../src/worker_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <libcamera/base/span.h>
+#include <libcamera/control_ids.h>
+#include <libcamera/controls.h>
+#include <libcamera/formats.h>
+#include <libcamera/geometry.h>
+#include <new>
+#include <numeric>
+#include <rclcpp/parameter.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// count heap allocations to report them per iteration
+static std::atomic<std::size_t> allocations {0};
+
+void *
+operator new(std::size_t size)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void
+operator delete(void *p) noexcept
+{
+  std::free(p);
+}
+
+void
+operator delete(void *p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+// allocations per iteration since 'begin'
+static void
+count_allocations(benchmark::State &state, const std::size_t begin)
+{
+  state.counters["allocs"] = benchmark::Counter(double(allocations.load() - begin),
+                                                benchmark::Counter::kAvgIterations);
+}
+
+template<typename T>
+static libcamera::ControlValue
+make_array(const std::size_t n)
+{
+  std::vector<T> values(n);
+  std::iota(values.begin(), values.end(), T(1));
+  return libcamera::ControlValue(libcamera::Span<const T>(values));
+}
+
+// extent: 0 for scalars, the fixed size or libcamera::dynamic_extent for arrays
+static void
+run_cv_to_pv(benchmark::State &state, const libcamera::ControlValue &value,
+             const std::size_t extent)
+{
+  const std::size_t begin = allocations.load();
+  for (auto _ : state)
+    benchmark::DoNotOptimize(cv_to_pv(value, extent));
+  count_allocations(state, begin);
+}
+
+static void
+BM_cv_to_pv_scalar(benchmark::State &state)
+{
+  switch (libcamera::ControlType(state.range(0))) {
+  case libcamera::ControlTypeBool:
+    return run_cv_to_pv(state, libcamera::ControlValue(true), 0);
+  case libcamera::ControlTypeByte:
+    return run_cv_to_pv(state, libcamera::ControlValue(CTByte(7)), 0);
+  case libcamera::ControlTypeInteger32:
+    return run_cv_to_pv(state, libcamera::ControlValue(CTInteger32(10000)), 0);
+  case libcamera::ControlTypeInteger64:
+    return run_cv_to_pv(state, libcamera::ControlValue(CTInteger64(33333)), 0);
+  case libcamera::ControlTypeFloat:
+    return run_cv_to_pv(state, libcamera::ControlValue(CTFloat(1.5)), 0);
+  case libcamera::ControlTypeString:
+    return run_cv_to_pv(state, libcamera::ControlValue(CTString("camera")), 0);
+  case libcamera::ControlTypeRectangle:
+    return run_cv_to_pv(state, libcamera::ControlValue(CTRectangle(0, 0, 640, 480)), 0);
+  case libcamera::ControlTypeSize:
+    return run_cv_to_pv(state, libcamera::ControlValue(CTSize(640, 480)), 0);
+  default:
+    state.SkipWithError("unsupported control type");
+  }
+}
+BENCHMARK(BM_cv_to_pv_scalar)
+  ->ArgName("type")
+  ->DenseRange(libcamera::ControlTypeBool, libcamera::ControlTypeSize);
+
+// arrays of the extents of e.g. ColourGains (2), ColourCorrectionMatrix (9) and dynamic arrays
+static void
+BM_cv_to_pv_array(benchmark::State &state)
+{
+  const std::size_t n = state.range(1);
+  switch (libcamera::ControlType(state.range(0))) {
+  case libcamera::ControlTypeByte:
+    return run_cv_to_pv(state, make_array<CTByte>(n), n);
+  case libcamera::ControlTypeInteger32:
+    return run_cv_to_pv(state, make_array<CTInteger32>(n), n);
+  case libcamera::ControlTypeInteger64:
+    return run_cv_to_pv(state, make_array<CTInteger64>(n), n);
+  case libcamera::ControlTypeFloat:
+    return run_cv_to_pv(state, make_array<CTFloat>(n), n);
+  default:
+    state.SkipWithError("unsupported control type");
+  }
+}
+BENCHMARK(BM_cv_to_pv_array)
+  ->ArgNames({"type", "extent"})
+  ->ArgsProduct({{libcamera::ControlTypeByte, libcamera::ControlTypeInteger32,
+                  libcamera::ControlTypeInteger64, libcamera::ControlTypeFloat},
+                 {2, 4, 9, 64}});
+
+// scalar broadcast to a fixed extent
+static void
+BM_cv_to_pv_broadcast(benchmark::State &state)
+{
+  run_cv_to_pv(state, libcamera::ControlValue(CTFloat(1.5)), state.range(0));
+}
+BENCHMARK(BM_cv_to_pv_broadcast)->ArgName("extent")->Arg(2)->Arg(9);
+
+static void
+run_pv_to_cv(benchmark::State &state, const rclcpp::Parameter &parameter,
+             const libcamera::ControlType type)
+{
+  const std::size_t begin = allocations.load();
+  for (auto _ : state)
+    benchmark::DoNotOptimize(pv_to_cv(parameter, type));
+  count_allocations(state, begin);
+}
+
+static void
+BM_pv_to_cv_scalar(benchmark::State &state)
+{
+  const libcamera::ControlType type = libcamera::ControlType(state.range(0));
+  switch (type) {
+  case libcamera::ControlTypeBool:
+    return run_pv_to_cv(state, rclcpp::Parameter("p", true), type);
+  case libcamera::ControlTypeInteger32:
+  case libcamera::ControlTypeInteger64:
+    return run_pv_to_cv(state, rclcpp::Parameter("p", 10000), type);
+  case libcamera::ControlTypeFloat:
+    return run_pv_to_cv(state, rclcpp::Parameter("p", 1.5), type);
+  case libcamera::ControlTypeString:
+    return run_pv_to_cv(state, rclcpp::Parameter("p", "camera"), type);
+  case libcamera::ControlTypeRectangle:
+    return run_pv_to_cv(state, rclcpp::Parameter("p", std::vector<int64_t> {0, 0, 640, 480}),
+                        type);
+  case libcamera::ControlTypeSize:
+    return run_pv_to_cv(state, rclcpp::Parameter("p", std::vector<int64_t> {640, 480}), type);
+  default:
+    state.SkipWithError("unsupported control type");
+  }
+}
+BENCHMARK(BM_pv_to_cv_scalar)
+  ->ArgName("type")
+  ->Arg(libcamera::ControlTypeBool)
+  ->Arg(libcamera::ControlTypeInteger32)
+  ->Arg(libcamera::ControlTypeInteger64)
+  ->Arg(libcamera::ControlTypeFloat)
+  ->Arg(libcamera::ControlTypeString)
+  ->Arg(libcamera::ControlTypeRectangle)
+  ->Arg(libcamera::ControlTypeSize);
+
+static void
+BM_pv_to_cv_array(benchmark::State &state)
+{
+  const libcamera::ControlType type = libcamera::ControlType(state.range(0));
+  const std::size_t n = state.range(1);
+  switch (type) {
+  case libcamera::ControlTypeByte:
+    return run_pv_to_cv(state, rclcpp::Parameter("p", std::vector<uint8_t>(n, 7)), type);
+  case libcamera::ControlTypeInteger32:
+  case libcamera::ControlTypeInteger64:
+    return run_pv_to_cv(state, rclcpp::Parameter("p", std::vector<int64_t>(n, 10000)), type);
+  case libcamera::ControlTypeFloat:
+    return run_pv_to_cv(state, rclcpp::Parameter("p", std::vector<double>(n, 1.5)), type);
+  default:
+    state.SkipWithError("unsupported control type");
+  }
+}
+BENCHMARK(BM_pv_to_cv_array)
+  ->ArgNames({"type", "extent"})
+  ->ArgsProduct({{libcamera::ControlTypeByte, libcamera::ControlTypeInteger32,
+                  libcamera::ControlTypeInteger64, libcamera::ControlTypeFloat},
+                 {2, 4, 9, 64}});
+
+static void
+run_clamp(benchmark::State &state, const libcamera::ControlValue &value,
+          const libcamera::ControlValue &min, const libcamera::ControlValue &max)
+{
+  const std::size_t begin = allocations.load();
+  for (auto _ : state)
+    benchmark::DoNotOptimize(clamp(value, min, max));
+  count_allocations(state, begin);
+}
+
+static void
+BM_clamp_scalar(benchmark::State &state)
+{
+  switch (libcamera::ControlType(state.range(0))) {
+  case libcamera::ControlTypeInteger32:
+    return run_clamp(state, libcamera::ControlValue(CTInteger32(50000)),
+                     libcamera::ControlValue(CTInteger32(0)),
+                     libcamera::ControlValue(CTInteger32(33333)));
+  case libcamera::ControlTypeInteger64:
+    return run_clamp(state, libcamera::ControlValue(CTInteger64(50000)),
+                     libcamera::ControlValue(CTInteger64(0)),
+                     libcamera::ControlValue(CTInteger64(33333)));
+  case libcamera::ControlTypeFloat:
+    return run_clamp(state, libcamera::ControlValue(CTFloat(20)),
+                     libcamera::ControlValue(CTFloat(1)), libcamera::ControlValue(CTFloat(16)));
+  case libcamera::ControlTypeRectangle:
+    return run_clamp(state, libcamera::ControlValue(CTRectangle(-10, -10, 700, 500)),
+                     libcamera::ControlValue(CTRectangle(0, 0, 0, 0)),
+                     libcamera::ControlValue(CTRectangle(0, 0, 640, 480)));
+  default:
+    state.SkipWithError("unsupported control type");
+  }
+}
+BENCHMARK(BM_clamp_scalar)
+  ->ArgName("type")
+  ->Arg(libcamera::ControlTypeInteger32)
+  ->Arg(libcamera::ControlTypeInteger64)
+  ->Arg(libcamera::ControlTypeFloat)
+  ->Arg(libcamera::ControlTypeRectangle);
+
+static void
+BM_clamp_array(benchmark::State &state)
+{
+  const std::size_t n = state.range(0);
+  const std::vector<CTFloat> min(n, 0), max(n, 32);
+  run_clamp(state, make_array<CTFloat>(n),
+            libcamera::ControlValue(libcamera::Span<const CTFloat>(min)),
+            libcamera::ControlValue(libcamera::Span<const CTFloat>(max)));
+}
+BENCHMARK(BM_clamp_array)->ArgName("extent")->Arg(2)->Arg(9)->Arg(64);
+
+static void
+BM_get_extent(benchmark::State &state)
+{
+  // first and last control of the lookup
+  const libcamera::ControlId *ids[] = {&libcamera::controls::AeEnable,
+                                       &libcamera::controls::ColourGains,
+                                       &libcamera::controls::AfPauseState};
+  const libcamera::ControlId *id = ids[state.range(0)];
+  const std::size_t begin = allocations.load();
+  for (auto _ : state)
+    benchmark::DoNotOptimize(get_extent(id));
+  count_allocations(state, begin);
+}
+BENCHMARK(BM_get_extent)->ArgName("control")->DenseRange(0, 2);
+
+static void
+BM_format_mapping(benchmark::State &state)
+{
+  const libcamera::PixelFormat formats[] = {libcamera::formats::YUYV, libcamera::formats::RGB888,
+                                            libcamera::formats::SBGGR16,
+                                            libcamera::formats::MJPEG, libcamera::formats::NV12};
+  const libcamera::PixelFormat &format = formats[state.range(0)];
+  const std::size_t begin = allocations.load();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(get_ros_encoding(format));
+    benchmark::DoNotOptimize(format_type(format));
+  }
+  count_allocations(state, begin);
+}
+BENCHMARK(BM_format_mapping)->ArgName("format")->DenseRange(0, 4);
+
+// parameter state with the controls of a typical camera
+static ParameterMap
+make_parameters_full()
+{
+  ParameterMap parameters;
+  parameters["AeEnable"] = rclcpp::ParameterValue(true);
+  parameters["AwbEnable"] = rclcpp::ParameterValue(false);
+  parameters["AfMode"] = rclcpp::ParameterValue(int64_t(2));
+  parameters["ExposureTime"] = rclcpp::ParameterValue(int64_t(10000));
+  parameters["AnalogueGain"] = rclcpp::ParameterValue(1.0);
+  parameters["ColourGains"] = rclcpp::ParameterValue(std::vector<double> {1.5, 1.2});
+  parameters["LensPosition"] = rclcpp::ParameterValue(1.0);
+  for (int i = 0; i < 64; i++)
+    parameters["Control" + std::to_string(i)] = rclcpp::ParameterValue(int64_t(i));
+  return parameters;
+}
+
+// batches of updates with one conflicting parameter in every 'conflict' parameters
+static void
+BM_check_conflicts(benchmark::State &state)
+{
+  const ParameterMap parameters_full = make_parameters_full();
+  const std::size_t n = state.range(0);
+  const std::size_t conflict = state.range(1);
+
+  std::vector<rclcpp::Parameter> parameters_new;
+  for (std::size_t i = 0; i < n; i++) {
+    if (conflict && i % conflict == 0)
+      parameters_new.emplace_back("ColourGains", std::vector<double> {1.0, 1.0});
+    else
+      parameters_new.emplace_back("Control" + std::to_string(i % 64), int64_t(i));
+  }
+  parameters_new.emplace_back("AwbEnable", true);
+
+  const std::size_t begin = allocations.load();
+  for (auto _ : state)
+    benchmark::DoNotOptimize(check_conflicts(parameters_new, parameters_full));
+  count_allocations(state, begin);
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_check_conflicts)
+  ->ArgNames({"updates", "conflict"})
+  ->ArgsProduct({{1, 16, 128, 512}, {0, 64}});
+
+static void
+BM_resolve_conflicts(benchmark::State &state)
+{
+  const ParameterMap parameters_default = make_parameters_full();
+  const ParameterMap parameters_overrides = {
+    {"ExposureTime", rclcpp::ParameterValue(int64_t(20000))},
+    {"LensPosition", rclcpp::ParameterValue(2.0)},
+  };
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    ParameterMap parameters = parameters_default;
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(resolve_conflicts(parameters, parameters_overrides));
+  }
+}
+BENCHMARK(BM_resolve_conflicts);
+
+// Bayer frame of a 12 MP sensor with smooth colour channels and a few bits of noise
+static std::vector<uint8_t>
+make_bayer_frame(const uint32_t width, const uint32_t height, const int bits)
+{
+  const std::size_t sample_size = bits > 8 ? 2 : 1;
+  const uint32_t max = (1u << bits) - 1;
+  std::vector<uint8_t> frame(std::size_t(width) * height * sample_size);
+  uint32_t noise = 1;
+  for (uint32_t y = 0; y < height; y++) {
+    for (uint32_t x = 0; x < width; x++) {
+      const uint32_t channel = (y % 2) * 2 + (x % 2);
+      const double level = (0.2 + 0.15 * channel) * (1 + 0.5 * x / width) * (1 - 0.3 * y / height);
+      noise = noise * 1664525 + 1013904223;
+      const uint32_t v =
+        std::min<uint32_t>(uint32_t(level * max) + (noise >> 28) * max / 1024, max);
+      const std::size_t i = std::size_t(y) * width + x;
+      if (sample_size == 2)
+        reinterpret_cast<uint16_t *>(frame.data())[i] = v;
+      else
+        frame[i] = v;
+    }
+  }
+  return frame;
+}
+
+static constexpr uint32_t bayer_width = 4056;
+static constexpr uint32_t bayer_height = 3040;
+
+// compression of 8-bit and 12-bit Bayer frames on all cores, reports the raw throughput and
+// the compression ratio
+static void
+BM_compress_raw(benchmark::State &state)
+{
+  const int bits = state.range(0);
+  const bool delta = state.range(1);
+  const std::vector<uint8_t> frame = make_bayer_frame(bayer_width, bayer_height, bits);
+  const ImageView image = {frame.data(), bayer_width, bayer_height,
+                           uint32_t(frame.size() / bayer_height),
+                           bits > 8 ? "bayer_rggb16" : "bayer_rggb8"};
+
+  WorkerPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+  std::vector<uint8_t> data;
+  for (auto _ : state) {
+    compress_raw(image, delta, pool, data);
+    benchmark::DoNotOptimize(data.data());
+  }
+  state.SetBytesProcessed(state.iterations() * frame.size());
+  state.counters["ratio"] = double(frame.size()) / data.size();
+}
+BENCHMARK(BM_compress_raw)
+  ->ArgNames({"bits", "delta"})
+  ->ArgsProduct({{8, 12}, {0, 1}})
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+static void
+BM_decompress_raw(benchmark::State &state)
+{
+  const int bits = state.range(0);
+  const bool delta = state.range(1);
+  const std::vector<uint8_t> frame = make_bayer_frame(bayer_width, bayer_height, bits);
+  const std::string encoding = bits > 8 ? "bayer_rggb16" : "bayer_rggb8";
+  const ImageView image = {frame.data(), bayer_width, bayer_height,
+                           uint32_t(frame.size() / bayer_height), encoding};
+
+  WorkerPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+  std::vector<uint8_t> data, pixels;
+  compress_raw(image, delta, pool, data);
+  for (auto _ : state) {
+    decompress_raw(data.data(), data.size(), encoding, pool, pixels);
+    benchmark::DoNotOptimize(pixels.data());
+  }
+  state.SetBytesProcessed(state.iterations() * frame.size());
+  state.counters["ratio"] = double(frame.size()) / data.size();
+}
+BENCHMARK(BM_decompress_raw)
+  ->ArgNames({"bits", "delta"})
+  ->ArgsProduct({{8, 12}, {0, 1}})
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+// sustained recording of frames to segments in the temporary directory ($TMPDIR),
+// the capture side waits for a free staging slot instead of dropping frames
+static void
+BM_frame_recorder(benchmark::State &state)
+{
+  const std::size_t frame_size = state.range(0);
+  const std::filesystem::path dir =
+    std::filesystem::temp_directory_path() / "camera_ros_benchmark_recorder";
+  std::filesystem::create_directories(dir);
+
+  std::vector<uint8_t> frame(frame_size, 0x55);
+  FrameIndexEntry entry = {};
+  entry.size = frame_size;
+  entry.width = frame_size;
+  entry.height = 1;
+  entry.step = frame_size;
+  set_frame_format(entry, "mono8");
+
+  FrameRecorder::Statistics stats;
+  std::chrono::duration<double> elapsed;
+  {
+    FrameRecorder recorder((dir / "frames").string(), uint64_t(256) << 20, frame_size, 16);
+    const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    for (auto _ : state) {
+      entry.sequence++;
+      while (!recorder.push(entry, frame.data()))
+        std::this_thread::yield();
+    }
+
+    // the sustained rate includes writing the queued frames
+    do {
+      std::this_thread::yield();
+      stats = recorder.statistics();
+    } while (stats.frames < uint64_t(state.iterations()) && stats.error.empty());
+    elapsed = std::chrono::steady_clock::now() - t0;
+  }
+  std::filesystem::remove_all(dir);
+
+  if (!stats.error.empty()) {
+    state.SkipWithError(stats.error.c_str());
+    return;
+  }
+  state.counters["MB/s"] = stats.bytes / elapsed.count() / 1e6;
+  state.counters["write MB/s"] = stats.bytes / stats.time_write / 1e6;
+  state.counters["direct"] = stats.direct;
+  state.counters["segments"] = stats.segments;
+}
+BENCHMARK(BM_frame_recorder)
+  ->ArgName("frame_size")
+  ->Arg(1920 * 1080 * 2)
+  ->Arg(4056 * 3040 * 2)
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+// copy kernels by index in 'copy_kernels()', on cached memory of a 2 MP YUYV and a 12 MP
+// 16-bit Bayer frame, kernels that the CPU does not support are skipped
+static void
+BM_copy_kernel(benchmark::State &state)
+{
+  const std::vector<CopyKernel> &kernels = copy_kernels();
+  if (std::size_t(state.range(0)) >= kernels.size()) {
+    state.SkipWithError("kernel not supported");
+    return;
+  }
+  const CopyKernel &kernel = kernels[state.range(0)];
+  const std::size_t size = state.range(1);
+
+  std::vector<uint8_t> src(size, 0x55), dst(size);
+  for (auto _ : state) {
+    kernel.copy(dst.data(), src.data(), size);
+    benchmark::DoNotOptimize(dst.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  state.SetLabel(kernel.name);
+}
+BENCHMARK(BM_copy_kernel)
+  ->ArgNames({"kernel", "size"})
+  ->ArgsProduct({{0, 1, 2}, {1920 * 1080 * 2, 4056 * 3040 * 2}})
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();